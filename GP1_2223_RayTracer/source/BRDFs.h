@@ -35,7 +35,7 @@ namespace dae
 		{
 			Vector3 r = l - 2 * Vector3::Dot(n, l) * n;
 			float cosAlpha = Vector3::Dot(r, v);
-			return ks * std::powf(cosAlpha,exp) * ColorRGB { 1.f, 1.f, 1.f };
+			return ks * powf(cosAlpha,exp) * ColorRGB { 1.f, 1.f, 1.f };
 		}
 
 		/**
@@ -47,7 +47,7 @@ namespace dae
 		 */
 		static ColorRGB FresnelFunction_Schlick(const Vector3& h, const Vector3& v, const ColorRGB& f0)
 		{
-			return f0 + (ColorRGB{ 1.f, 1.f, 1.f } - f0)*std::powf(1-Vector3::Dot(h,v),5);
+			return f0 + (ColorRGB{ 1.f, 1.f, 1.f } - f0)*powf(1-Vector3::Dot(h,v),5);
 		}
 
 		/**
@@ -59,8 +59,8 @@ namespace dae
 		 */
 		static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, float roughness)
 		{
-			const float alpha2 = std::powf(roughness, 4);
-			return alpha2 / (PI*std::powf(std::powf(Vector3::Dot(n,h),2)*(alpha2-1)+1,2));
+			const float alpha2 = powf(roughness, 4);
+			return alpha2 / (PI*powf(powf(Vector3::Dot(n,h),2)*(alpha2-1)+1,2));
 		}
 
 
@@ -74,7 +74,7 @@ namespace dae
 		static float GeometryFunction_SchlickGGX(const Vector3& n, const Vector3& v, float roughness)
 		{
 			auto nv = Vector3::Dot(n, v);
-			auto k = std::powf(roughness * roughness + 1, 2) / 8.f;
+			auto k = powf(roughness * roughness + 1, 2) / 8.f;
 			return nv/(nv*(1-k)+k);
 		}
 
@@ -0,0 +1,595 @@
+#include "BVH.h"
+
+#include <chrono>
+#include <numeric>
+
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr uint32_t g_BinCount{ 16 };
+		constexpr uint32_t g_MaxLeafSize{ 16 };
+		//Primitives per job of a pass over a large node
+		constexpr size_t g_BlockSize{ 1 << 14 };
+
+		//The builder partitions these instead of an index list, so a split reads its primitives sequentially
+		struct BuildPrimitive
+		{
+			AABB bounds{};
+			Vector3 centroid{};
+			uint32_t index{}; //Into the primitiveBounds passed to Build
+		};
+
+		//Bins of all three axes, filled in one pass over the primitives
+		struct Bins
+		{
+			AABB bounds[3][g_BinCount]{};
+			uint32_t counts[3][g_BinCount]{};
+
+			void Merge(const Bins& other)
+			{
+				for (int axis{}; axis < 3; ++axis)
+				{
+					for (uint32_t i{}; i < g_BinCount; ++i)
+					{
+						bounds[axis][i].Grow(other.bounds[axis][i]);
+						counts[axis][i] += other.counts[axis][i];
+					}
+				}
+			}
+		};
+
+		//Shared by the build tasks, every task only touches its own nodes and primitive range
+		struct Builder
+		{
+			ThreadPool* pThreadPool{};
+			uint32_t maxDepth{};
+			std::vector<BuildPrimitive> primitives{};
+			std::vector<BuildPrimitive> scratch{}; //Partition target of the large nodes
+			//Arena of 2N - 1 nodes (the most a binary tree over N leaves can have), every subtree task gets its own slab
+			std::vector<BVHNode> nodes{};
+		};
+
+		AABB GetPrimitiveBounds(const BuildPrimitive* pPrimitives, size_t count)
+		{
+			AABB bounds{};
+			for (size_t i{}; i < count; ++i)
+			{
+				bounds.Grow(pPrimitives[i].bounds);
+			}
+			return bounds;
+		}
+
+		AABB GetCentroidBounds(const BuildPrimitive* pPrimitives, size_t count)
+		{
+			AABB bounds{};
+			for (size_t i{}; i < count; ++i)
+			{
+				bounds.Grow(pPrimitives[i].centroid);
+			}
+			return bounds;
+		}
+
+		//Block by block over the threads, growing is exact so the result does not depend on the blocks
+		template<typename GetBlockBounds>
+		AABB GetBoundsParallel(ThreadPool* pThreadPool, const BuildPrimitive* pPrimitives, size_t count, GetBlockBounds getBlockBounds)
+		{
+			std::vector<AABB> blockBounds((count + g_BlockSize - 1) / g_BlockSize);
+			ParallelForBlocks(pThreadPool, count, g_BlockSize, [&](size_t first, size_t end)
+				{
+					blockBounds[first / g_BlockSize] = getBlockBounds(pPrimitives + first, end - first);
+				});
+
+			AABB bounds{};
+			for (const AABB& block : blockBounds)
+			{
+				bounds.Grow(block);
+			}
+			return bounds;
+		}
+
+		//Axes without centroid extent can not be split and stay empty
+		void FillBins(const BuildPrimitive* pPrimitives, size_t count, const AABB& centroidBounds, Bins& bins)
+		{
+			for (int axis{}; axis < 3; ++axis)
+			{
+				const float boundsMin{ centroidBounds.min[axis] };
+				const float boundsMax{ centroidBounds.max[axis] };
+				if (boundsMax <= boundsMin)
+					continue;
+
+				const float scale{ g_BinCount / (boundsMax - boundsMin) };
+				for (size_t i{}; i < count; ++i)
+				{
+					const uint32_t binIndex{ std::min(g_BinCount - 1, static_cast<uint32_t>((pPrimitives[i].centroid[axis] - boundsMin) * scale)) };
+					++bins.counts[axis][binIndex];
+					bins.bounds[axis][binIndex].Grow(pPrimitives[i].bounds);
+				}
+			}
+		}
+
+		/**
+		 * \brief Evaluates the SAH at every bin plane of every axis
+		 * \return cost of the best split relative to the leaf cost (= primitive count), FLT_MAX when no plane splits the node
+		 */
+		float FindBestSplit(const Bins& bins, const AABB& centroidBounds, float nodeArea, int& axis, float& splitPosition)
+		{
+			float bestCost{ FLT_MAX };
+
+			for (int currentAxis{}; currentAxis < 3; ++currentAxis)
+			{
+				const float boundsMin{ centroidBounds.min[currentAxis] };
+				const float boundsMax{ centroidBounds.max[currentAxis] };
+				if (boundsMax <= boundsMin)
+					continue;
+
+				//Sweep from both sides to get the area and count on each side of every bin plane
+				const AABB* pBinBounds{ bins.bounds[currentAxis] };
+				const uint32_t* pBinCounts{ bins.counts[currentAxis] };
+				float leftAreas[g_BinCount - 1]{};
+				float rightAreas[g_BinCount - 1]{};
+				uint32_t leftCounts[g_BinCount - 1]{};
+				uint32_t rightCounts[g_BinCount - 1]{};
+				AABB leftBox{};
+				AABB rightBox{};
+				uint32_t leftSum{};
+				uint32_t rightSum{};
+				for (uint32_t i{}; i < g_BinCount - 1; ++i)
+				{
+					leftSum += pBinCounts[i];
+					leftCounts[i] = leftSum;
+					leftBox.Grow(pBinBounds[i]);
+					leftAreas[i] = leftBox.GetSurfaceArea();
+
+					rightSum += pBinCounts[g_BinCount - 1 - i];
+					rightCounts[g_BinCount - 2 - i] = rightSum;
+					rightBox.Grow(pBinBounds[g_BinCount - 1 - i]);
+					rightAreas[g_BinCount - 2 - i] = rightBox.GetSurfaceArea();
+				}
+
+				//Evaluate the SAH for every bin plane
+				const float binWidth{ (boundsMax - boundsMin) / g_BinCount };
+				for (uint32_t i{}; i < g_BinCount - 1; ++i)
+				{
+					if (leftCounts[i] == 0 || rightCounts[i] == 0)
+						continue;
+
+					const float cost{ leftCounts[i] * leftAreas[i] + rightCounts[i] * rightAreas[i] };
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						axis = currentAxis;
+						splitPosition = boundsMin + binWidth * (i + 1);
+					}
+				}
+			}
+
+			if (bestCost == FLT_MAX)
+				return FLT_MAX;
+
+			//Traversal cost of 1 + expected intersection cost, relative to the leaf cost (= primitiveCount)
+			return nodeArea > 0.f ? 1.f + bestCost / nodeArea : 1.f;
+		}
+
+		//Keep the leaf when splitting does not pay off (and the leaf is small enough)
+		bool IsSplitWorthIt(float splitCost, uint32_t primitiveCount)
+		{
+			const float leafCost{ static_cast<float>(primitiveCount) };
+			return splitCost != FLT_MAX && (splitCost < leafCost || primitiveCount > g_MaxLeafSize);
+		}
+
+		//Splits a node on the calling thread, false keeps it a leaf
+		bool SplitNode(Builder& builder, const BVHNode& node, BVHNode& left, BVHNode& right)
+		{
+			BuildPrimitive* pFirst{ builder.primitives.data() + node.leftFirst };
+			const AABB centroidBounds{ GetCentroidBounds(pFirst, node.primitiveCount) };
+			Bins bins{};
+			FillBins(pFirst, node.primitiveCount, centroidBounds, bins);
+
+			int axis{};
+			float splitPosition{};
+			if (!IsSplitWorthIt(FindBestSplit(bins, centroidBounds, node.bounds.GetSurfaceArea(), axis, splitPosition), node.primitiveCount))
+				return false;
+
+			//Partition the primitives around the split plane
+			BuildPrimitive* pMiddle{ std::partition(pFirst, pFirst + node.primitiveCount, [&](const BuildPrimitive& primitive)
+				{
+					return primitive.centroid[axis] < splitPosition;
+				}) };
+
+			const uint32_t leftCount{ static_cast<uint32_t>(pMiddle - pFirst) };
+			if (leftCount == 0 || leftCount == node.primitiveCount)
+				return false;
+
+			left.leftFirst = node.leftFirst;
+			left.primitiveCount = leftCount;
+			left.bounds = GetPrimitiveBounds(pFirst, leftCount);
+
+			right.leftFirst = node.leftFirst + leftCount;
+			right.primitiveCount = node.primitiveCount - leftCount;
+			right.bounds = GetPrimitiveBounds(pMiddle, right.primitiveCount);
+			return true;
+		}
+
+		//SplitNode with every pass spread over the threads, the partition is stable so the result does not depend on the blocks
+		bool SplitLargeNode(Builder& builder, const BVHNode& node, BVHNode& left, BVHNode& right)
+		{
+			ThreadPool* pThreadPool{ builder.pThreadPool };
+			BuildPrimitive* pFirst{ builder.primitives.data() + node.leftFirst };
+			const size_t count{ node.primitiveCount };
+			const size_t blockCount{ (count + g_BlockSize - 1) / g_BlockSize };
+
+			const AABB centroidBounds{ GetBoundsParallel(pThreadPool, pFirst, count, GetCentroidBounds) };
+			std::vector<Bins> blockBins(blockCount);
+			ParallelForBlocks(pThreadPool, count, g_BlockSize, [&](size_t first, size_t end)
+				{
+					FillBins(pFirst + first, end - first, centroidBounds, blockBins[first / g_BlockSize]);
+				});
+			for (size_t block{ 1 }; block < blockCount; ++block)
+			{
+				blockBins[0].Merge(blockBins[block]);
+			}
+
+			int axis{};
+			float splitPosition{};
+			if (!IsSplitWorthIt(FindBestSplit(blockBins[0], centroidBounds, node.bounds.GetSurfaceArea(), axis, splitPosition), node.primitiveCount))
+				return false;
+
+			//Count the left side of every block, then every block copies its primitives to its own offsets on both sides
+			const auto isLeft = [&](const BuildPrimitive& primitive) { return primitive.centroid[axis] < splitPosition; };
+			std::vector<size_t> leftOffsets(blockCount);
+			ParallelForBlocks(pThreadPool, count, g_BlockSize, [&](size_t first, size_t end)
+				{
+					leftOffsets[first / g_BlockSize] = static_cast<size_t>(std::count_if(pFirst + first, pFirst + end, isLeft));
+				});
+
+			size_t leftCount{};
+			for (size_t& offset : leftOffsets)
+			{
+				const size_t blockLeftCount{ offset };
+				offset = leftCount;
+				leftCount += blockLeftCount;
+			}
+			if (leftCount == 0 || leftCount == count)
+				return false;
+
+			BuildPrimitive* pScratch{ builder.scratch.data() + node.leftFirst };
+			ParallelForBlocks(pThreadPool, count, g_BlockSize, [&](size_t first, size_t end)
+				{
+					size_t leftIndex{ leftOffsets[first / g_BlockSize] };
+					size_t rightIndex{ leftCount + (first - leftIndex) };
+					for (size_t i{ first }; i < end; ++i)
+					{
+						pScratch[isLeft(pFirst[i]) ? leftIndex++ : rightIndex++] = pFirst[i];
+					}
+				});
+			ParallelForBlocks(pThreadPool, count, g_BlockSize, [&](size_t first, size_t end)
+				{
+					std::copy(pScratch + first, pScratch + end, pFirst + first);
+				});
+
+			left.leftFirst = node.leftFirst;
+			left.primitiveCount = static_cast<uint32_t>(leftCount);
+			left.bounds = GetBoundsParallel(pThreadPool, pFirst, leftCount, GetPrimitiveBounds);
+
+			right.leftFirst = node.leftFirst + left.primitiveCount;
+			right.primitiveCount = node.primitiveCount - left.primitiveCount;
+			right.bounds = GetBoundsParallel(pThreadPool, pFirst + leftCount, right.primitiveCount, GetPrimitiveBounds);
+			return true;
+		}
+
+		/**
+		 * \brief Builds the subtree below a node on the calling thread, depth first with an explicit stack of (node, depth)
+		 * \param rootIndex node to subdivide, already in the arena
+		 * \param rootDepth depth of that node
+		 * \param firstFreeNode first node of the arena slab of this subtree, big enough for 2 * primitiveCount - 2 nodes
+		 * \return number of nodes used from the slab
+		 */
+		uint32_t BuildSubtree(Builder& builder, uint32_t rootIndex, uint32_t rootDepth, uint32_t firstFreeNode)
+		{
+			uint32_t nextFreeNode{ firstFreeNode };
+			std::vector<std::pair<uint32_t, uint32_t>> workStack{};
+			workStack.emplace_back(rootIndex, rootDepth);
+
+			while (!workStack.empty())
+			{
+				const auto [nodeIndex, depth] = workStack.back();
+				workStack.pop_back();
+
+				BVHNode& node{ builder.nodes[nodeIndex] };
+				if (node.primitiveCount <= 1 || depth >= builder.maxDepth)
+					continue;
+
+				BVHNode left{};
+				BVHNode right{};
+				if (!SplitNode(builder, node, left, right))
+					continue;
+
+				const uint32_t leftIndex{ nextFreeNode };
+				nextFreeNode += 2;
+				node.leftFirst = leftIndex;
+				node.primitiveCount = 0;
+				builder.nodes[leftIndex] = left;
+				builder.nodes[leftIndex + 1] = right;
+
+				workStack.emplace_back(leftIndex, depth + 1);
+				workStack.emplace_back(leftIndex + 1, depth + 1);
+			}
+			return nextFreeNode - firstFreeNode;
+		}
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool, BuildStats* pStats)
+	{
+		using Clock = std::chrono::steady_clock;
+		const auto start{ Clock::now() };
+
+		Clear();
+
+		BuildStats stats{};
+		stats.threadCount = pThreadPool ? pThreadPool->GetThreadCount() : 1;
+
+		const uint32_t primitiveCount{ static_cast<uint32_t>(primitiveBounds.size()) };
+		if (primitiveCount > 0)
+		{
+			Builder builder{};
+			builder.pThreadPool = pThreadPool;
+			builder.maxDepth = maxDepth;
+			builder.primitives.resize(primitiveCount);
+			ParallelForBlocks(pThreadPool, primitiveCount, g_BlockSize, [&](size_t first, size_t end)
+				{
+					for (size_t i{ first }; i < end; ++i)
+					{
+						builder.primitives[i] = { primitiveBounds[i], primitiveBounds[i].GetCentroid(), static_cast<uint32_t>(i) };
+					}
+				});
+			builder.nodes.resize(2 * static_cast<size_t>(primitiveCount) - 1);
+
+			BVHNode& root{ builder.nodes[0] };
+			root.leftFirst = 0;
+			root.primitiveCount = primitiveCount;
+			root.bounds = GetBoundsParallel(pThreadPool, builder.primitives.data(), primitiveCount, GetPrimitiveBounds);
+			uint32_t nodeCount{ 1 };
+
+			//Split the large nodes one at a time with every thread, what is left are subtrees small enough for one task
+			std::vector<std::pair<uint32_t, uint32_t>> largeNodes{ { 0, 0 } };
+			std::vector<std::pair<uint32_t, uint32_t>> subtrees{};
+			while (!largeNodes.empty())
+			{
+				const auto [nodeIndex, depth] = largeNodes.back();
+				largeNodes.pop_back();
+
+				BVHNode& node{ builder.nodes[nodeIndex] };
+				if (node.primitiveCount <= parallelBuildSize)
+				{
+					subtrees.emplace_back(nodeIndex, depth);
+					continue;
+				}
+				if (depth >= maxDepth)
+					continue;
+
+				if (builder.scratch.empty())
+					builder.scratch.resize(primitiveCount);
+
+				BVHNode left{};
+				BVHNode right{};
+				if (!SplitLargeNode(builder, node, left, right))
+					continue;
+
+				node.leftFirst = nodeCount;
+				node.primitiveCount = 0;
+				builder.nodes[nodeCount] = left;
+				builder.nodes[nodeCount + 1] = right;
+				largeNodes.emplace_back(nodeCount, depth + 1);
+				largeNodes.emplace_back(nodeCount + 1, depth + 1);
+				nodeCount += 2;
+				++stats.largeNodeCount;
+			}
+			builder.scratch = {};
+
+			//Every subtree gets a slab of the arena with room for its largest possible tree, so the tasks allocate without locking
+			std::vector<uint32_t> slabOffsets(subtrees.size());
+			size_t slabEnd{ nodeCount };
+			for (size_t i{}; i < subtrees.size(); ++i)
+			{
+				slabOffsets[i] = static_cast<uint32_t>(slabEnd);
+				slabEnd += 2 * static_cast<size_t>(builder.nodes[subtrees[i].first].primitiveCount) - 2;
+			}
+
+			//Largest subtrees first, the small ones fill up the threads at the end
+			std::vector<uint32_t> taskOrder(subtrees.size());
+			std::iota(taskOrder.begin(), taskOrder.end(), 0u);
+			std::sort(taskOrder.begin(), taskOrder.end(), [&](uint32_t a, uint32_t b)
+				{
+					return builder.nodes[subtrees[a].first].primitiveCount > builder.nodes[subtrees[b].first].primitiveCount;
+				});
+
+			std::vector<uint32_t> subtreeNodeCounts(subtrees.size());
+			const auto buildSubtree = [&](uint32_t task)
+				{
+					const uint32_t i{ taskOrder[task] };
+					subtreeNodeCounts[i] = BuildSubtree(builder, subtrees[i].first, subtrees[i].second, slabOffsets[i]);
+				};
+			if (pThreadPool && subtrees.size() > 1)
+			{
+				pThreadPool->ParallelFor(static_cast<uint32_t>(subtrees.size()), buildSubtree);
+			}
+			else
+			{
+				for (uint32_t task{}; task < subtrees.size(); ++task)
+				{
+					buildSubtree(task);
+				}
+			}
+
+			//Renumber depth first into m_Nodes, in the order a build on one thread allocates them, which drops the unused slab nodes
+			m_Nodes.resize(nodeCount + std::accumulate(subtreeNodeCounts.begin(), subtreeNodeCounts.end(), size_t{}));
+			m_Nodes[0] = builder.nodes[0];
+			uint32_t nextNode{ 1 };
+			std::vector<std::pair<uint32_t, uint32_t>> renumberStack{ { 0, 0 } }; //(arena node, node)
+			while (!renumberStack.empty())
+			{
+				const auto [arenaIndex, nodeIndex] = renumberStack.back();
+				renumberStack.pop_back();
+
+				const BVHNode& arenaNode{ builder.nodes[arenaIndex] };
+				m_Nodes[nodeIndex] = arenaNode;
+				if (arenaNode.IsLeaf())
+					continue;
+
+				m_Nodes[nodeIndex].leftFirst = nextNode;
+				renumberStack.emplace_back(arenaNode.leftFirst, nextNode);
+				renumberStack.emplace_back(arenaNode.leftFirst + 1, nextNode + 1);
+				nextNode += 2;
+			}
+
+			m_PrimitiveIndices.resize(primitiveCount);
+			ParallelForBlocks(pThreadPool, primitiveCount, g_BlockSize, [&](size_t first, size_t end)
+				{
+					for (size_t i{ first }; i < end; ++i)
+					{
+						m_PrimitiveIndices[i] = builder.primitives[i].index;
+					}
+				});
+
+			stats.subtreeCount = static_cast<uint32_t>(subtrees.size());
+		}
+
+		if (pStats)
+		{
+			stats.nodeCount = m_Nodes.size();
+			stats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			*pStats = stats;
+		}
+	}
+
+	void BVH::Assign(const BVHNode* pNodes, size_t nodeCount, const uint32_t* pPrimitiveIndices, size_t primitiveCount)
+	{
+		m_Nodes.assign(pNodes, pNodes + nodeCount);
+		m_PrimitiveIndices.assign(pPrimitiveIndices, pPrimitiveIndices + primitiveCount);
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool)
+	{
+		if (m_Nodes.empty())
+			return;
+
+		//Children are always stored after their parent, walking backwards refits the children first
+		if (!pThreadPool || pThreadPool->GetThreadCount() == 1 || m_Nodes.size() < m_MinParallelRefitNodeCount)
+		{
+			for (size_t i{ m_Nodes.size() }; i-- > 0;)
+			{
+				RefitNode(m_Nodes[i], primitiveBounds);
+			}
+			return;
+		}
+
+		//Split the top of the tree level by level into a few subtrees per thread, so uneven subtrees even out
+		const size_t targetSubtreeCount{ 4 * static_cast<size_t>(pThreadPool->GetThreadCount()) };
+		std::vector<uint32_t> subtreeRoots{ 0 };
+		std::vector<uint32_t> topNodes{};
+		bool canSplit{ true };
+		while (canSplit && subtreeRoots.size() < targetSubtreeCount)
+		{
+			canSplit = false;
+			std::vector<uint32_t> nextRoots{};
+			nextRoots.reserve(2 * subtreeRoots.size());
+			for (const uint32_t rootIndex : subtreeRoots)
+			{
+				const BVHNode& root{ m_Nodes[rootIndex] };
+				if (root.IsLeaf())
+				{
+					nextRoots.emplace_back(rootIndex);
+					continue;
+				}
+
+				topNodes.emplace_back(rootIndex);
+				nextRoots.emplace_back(root.leftFirst);
+				nextRoots.emplace_back(root.leftFirst + 1);
+				canSplit = true;
+			}
+			subtreeRoots.swap(nextRoots);
+		}
+
+		pThreadPool->ParallelFor(static_cast<uint32_t>(subtreeRoots.size()), [&](uint32_t i)
+			{
+				RefitSubtree(subtreeRoots[i], primitiveBounds);
+			});
+
+		//The top nodes were gathered level by level, backwards every child comes before its parent
+		for (auto it{ topNodes.rbegin() }; it != topNodes.rend(); ++it)
+		{
+			RefitNode(m_Nodes[*it], primitiveBounds);
+		}
+	}
+
+	void BVH::Clear()
+	{
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+	}
+
+	float BVH::GetCost() const
+	{
+		if (m_Nodes.empty())
+			return 0.f;
+
+		//Same costs as the build: 1 per interior node, 1 per primitive in a leaf, weighted by the chance a ray enters the node
+		float cost{};
+		for (const BVHNode& node : m_Nodes)
+		{
+			cost += node.bounds.GetSurfaceArea() * (node.IsLeaf() ? static_cast<float>(node.primitiveCount) : 1.f);
+		}
+
+		const float rootArea{ m_Nodes[0].bounds.GetSurfaceArea() };
+		return rootArea > 0.f ? cost / rootArea : 0.f;
+	}
+
+	void BVH::UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const
+	{
+		node.bounds = {};
+		for (uint32_t i{}; i < node.primitiveCount; ++i)
+		{
+			node.bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+	}
+
+	void BVH::RefitNode(BVHNode& node, const std::vector<AABB>& primitiveBounds)
+	{
+		if (node.IsLeaf())
+		{
+			UpdateNodeBounds(node, primitiveBounds);
+			return;
+		}
+
+		node.bounds = m_Nodes[node.leftFirst].bounds;
+		node.bounds.Grow(m_Nodes[node.leftFirst + 1].bounds);
+	}
+
+	void BVH::RefitSubtree(uint32_t rootIndex, const std::vector<AABB>& primitiveBounds)
+	{
+		//Depth first order puts every parent before its children, backwards they are refitted first
+		std::vector<uint32_t> order{};
+		std::vector<uint32_t> stack{ rootIndex };
+		while (!stack.empty())
+		{
+			const uint32_t nodeIndex{ stack.back() };
+			stack.pop_back();
+			order.emplace_back(nodeIndex);
+
+			const BVHNode& node{ m_Nodes[nodeIndex] };
+			if (!node.IsLeaf())
+			{
+				stack.emplace_back(node.leftFirst);
+				stack.emplace_back(node.leftFirst + 1);
+			}
+		}
+
+		for (auto it{ order.rbegin() }; it != order.rend(); ++it)
+		{
+			RefitNode(m_Nodes[*it], primitiveBounds);
+		}
+	}
+}
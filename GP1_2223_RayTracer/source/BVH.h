@@ -0,0 +1,349 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "Statistics.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+#pragma region AABB
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+			max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = { std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z) };
+			max = { std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z) };
+		}
+
+		Vector3 GetCentroid() const
+		{
+			return { (min.x + max.x) * .5f, (min.y + max.y) * .5f, (min.z + max.z) * .5f };
+		}
+
+		float GetSurfaceArea() const
+		{
+			const float dx{ max.x - min.x };
+			const float dy{ max.y - min.y };
+			const float dz{ max.z - min.z };
+			if (dx < 0.f || dy < 0.f || dz < 0.f) return 0.f;
+			return 2.f * (dx * dy + dy * dz + dz * dx);
+		}
+	};
+
+	/**
+	 * \brief Slab test of a ray against an AABB
+	 * \param box box to test against
+	 * \param origin ray origin
+	 * \param invDirection component wise reciprocal of the ray direction
+	 * \param tMin start of the ray interval
+	 * \param tMax end of the ray interval
+	 * \return entry distance of the ray into the box, FLT_MAX on a miss
+	 */
+	inline float HitTest_AABB(const AABB& box, const Vector3& origin, const Vector3& invDirection, float tMin, float tMax)
+	{
+		const float tx1{ (box.min.x - origin.x) * invDirection.x };
+		const float tx2{ (box.max.x - origin.x) * invDirection.x };
+		float tNear{ std::min(tx1, tx2) };
+		float tFar{ std::max(tx1, tx2) };
+
+		const float ty1{ (box.min.y - origin.y) * invDirection.y };
+		const float ty2{ (box.max.y - origin.y) * invDirection.y };
+		tNear = std::max(tNear, std::min(ty1, ty2));
+		tFar = std::min(tFar, std::max(ty1, ty2));
+
+		const float tz1{ (box.min.z - origin.z) * invDirection.z };
+		const float tz2{ (box.max.z - origin.z) * invDirection.z };
+		tNear = std::max(tNear, std::min(tz1, tz2));
+		tFar = std::min(tFar, std::max(tz1, tz2));
+
+		if (tFar >= tNear && tFar >= tMin && tNear <= tMax)
+			return std::max(tNear, tMin);
+
+		return FLT_MAX;
+	}
+
+	/**
+	 * \brief Slab test of every active lane of a packet against an AABB
+	 * \param box box to test against
+	 * \param packet packet to test, lanes are clipped to [tMin, tMax]
+	 * \param tNear entry distance of every lane
+	 * \return mask of the lanes that hit the box
+	 */
+	inline int HitTest_AABB(const AABB& box, const RayPacket& packet, SimdFloat& tNear)
+	{
+		const SimdFloat tx1{ (SimdFloat{ box.min.x } - packet.origin.x) * packet.invDirection.x };
+		const SimdFloat tx2{ (SimdFloat{ box.max.x } - packet.origin.x) * packet.invDirection.x };
+		tNear = SimdFloat::Min(tx1, tx2);
+		SimdFloat tFar{ SimdFloat::Max(tx1, tx2) };
+
+		const SimdFloat ty1{ (SimdFloat{ box.min.y } - packet.origin.y) * packet.invDirection.y };
+		const SimdFloat ty2{ (SimdFloat{ box.max.y } - packet.origin.y) * packet.invDirection.y };
+		tNear = SimdFloat::Max(tNear, SimdFloat::Min(ty1, ty2));
+		tFar = SimdFloat::Min(tFar, SimdFloat::Max(ty1, ty2));
+
+		const SimdFloat tz1{ (SimdFloat{ box.min.z } - packet.origin.z) * packet.invDirection.z };
+		const SimdFloat tz2{ (SimdFloat{ box.max.z } - packet.origin.z) * packet.invDirection.z };
+		tNear = SimdFloat::Max(tNear, SimdFloat::Min(tz1, tz2));
+		tFar = SimdFloat::Min(tFar, SimdFloat::Max(tz1, tz2));
+
+		return SimdFloat::MoveMask((tFar >= tNear) & (tFar >= SimdFloat{ packet.tMin }) & (tNear <= packet.tMax));
+	}
+#pragma endregion
+
+#pragma region BVH
+	struct BVHNode
+	{
+		AABB bounds{};
+
+		//Leaf: index of the first primitive, Interior: index of the left child (right child = leftFirst + 1)
+		uint32_t leftFirst{};
+		uint32_t primitiveCount{};
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	//Bounding Volume Hierarchy built with the Surface Area Heuristic (binned)
+	//The BVH only knows about primitive bounds, the owner does the actual primitive hit tests.
+	class BVH final
+	{
+	public:
+		//Nodes with more primitives are split by every thread together, smaller nodes are built as one task with their subtree
+		static constexpr uint32_t parallelBuildSize{ 1 << 16 };
+		//Deepest node depth (the root is 0), keeps Traverse within its fixed size stack
+		static constexpr uint32_t maxDepth{ 60 };
+
+		//What Build did and how long it took
+		struct BuildStats
+		{
+			uint32_t threadCount{};
+			uint32_t largeNodeCount{}; //Split by every thread together
+			uint32_t subtreeCount{}; //Built as one task each
+			size_t nodeCount{};
+			double milliseconds{};
+		};
+
+		BVH() = default;
+		~BVH() = default;
+
+		BVH(const BVH&) = default;
+		BVH(BVH&&) noexcept = default;
+		BVH& operator=(const BVH&) = default;
+		BVH& operator=(BVH&&) noexcept = default;
+
+		/**
+		 * \brief (Re)builds the hierarchy, afterwards GetPrimitiveIndices() maps leaf slots to primitiveBounds indices.
+		 * The tree is the same for every thread count
+		 * \param primitiveBounds bounds of every primitive
+		 * \param pThreadPool spreads the build over its threads when given, nullptr builds on the calling thread
+		 * \param pStats optional, filled with how the build was split up and how long it took
+		 */
+		void Build(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool = nullptr, BuildStats* pStats = nullptr);
+		//Takes a hierarchy built before (e.g. read from a mesh cache) as it is, nothing is checked
+		void Assign(const BVHNode* pNodes, size_t nodeCount, const uint32_t* pPrimitiveIndices, size_t primitiveCount);
+		/**
+		 * \brief Recalculates the node bounds bottom up for moved primitives, the tree itself is kept (see GetCost)
+		 * \param primitiveBounds new bounds of every primitive, indexed like the bounds passed to Build
+		 * \param pThreadPool refits independent subtrees in parallel when given, nullptr refits on the calling thread
+		 */
+		void Refit(const std::vector<AABB>& primitiveBounds, ThreadPool* pThreadPool = nullptr);
+		void Clear();
+
+		//Surface Area Heuristic cost of the tree relative to the area of the root, grows as refits make the tree worse
+		float GetCost() const;
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		const AABB& GetBounds() const { return m_Nodes[0].bounds; }
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+		/**
+		 * \brief Walks the hierarchy front to back and hands every leaf the ray enters to onLeaf
+		 * \param ray ray to traverse with
+		 * \param tMax closest distance found so far, nodes further away are skipped
+		 * \param onLeaf bool(uint32_t first, uint32_t count, float& tMax), may shrink tMax, returns true to stop traversal
+		 */
+		template<typename LeafFunc>
+		void Traverse(const Ray& ray, float tMax, LeafFunc&& onLeaf) const;
+
+		/**
+		 * \brief Packet version of Traverse, a node is visited when any active lane enters it
+		 * \param packet packet to traverse with, onLeaf shrinks packet.tMax
+		 * \param onLeaf void(uint32_t first, uint32_t count)
+		 */
+		template<typename LeafFunc>
+		void TraversePacket(RayPacket& packet, LeafFunc&& onLeaf) const;
+
+	private:
+		static constexpr size_t m_MinParallelRefitNodeCount{ 4096 }; //Smaller trees refit faster than the tasks start
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+
+		void UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const;
+		void RefitNode(BVHNode& node, const std::vector<AABB>& primitiveBounds);
+		void RefitSubtree(uint32_t rootIndex, const std::vector<AABB>& primitiveBounds);
+	};
+
+	template<typename LeafFunc>
+	void BVH::Traverse(const Ray& ray, float tMax, LeafFunc&& onLeaf) const
+	{
+		if (m_Nodes.empty())
+			return;
+
+		tMax = std::min(tMax, ray.max);
+		const Vector3 invDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+		RAYTRACER_STATS_ONLY(uint64_t& nodeTests{ Statistics::GetCounters().nodeTests });
+		RAYTRACER_STATS_ONLY(++nodeTests);
+		if (HitTest_AABB(m_Nodes[0].bounds, ray.origin, invDirection, ray.min, tMax) == FLT_MAX)
+			return;
+
+		uint32_t stack[64];
+		uint32_t stackSize{};
+		uint32_t nodeIndex{};
+
+		while (true)
+		{
+			const BVHNode& node{ m_Nodes[nodeIndex] };
+			if (node.IsLeaf())
+			{
+				if (onLeaf(node.leftFirst, node.primitiveCount, tMax))
+					return;
+			}
+			else
+			{
+				//Visit the closest child first, push the other one
+				uint32_t nearIndex{ node.leftFirst };
+				uint32_t farIndex{ node.leftFirst + 1 };
+				RAYTRACER_STATS_ONLY(nodeTests += 2);
+				float tNear{ HitTest_AABB(m_Nodes[nearIndex].bounds, ray.origin, invDirection, ray.min, tMax) };
+				float tFar{ HitTest_AABB(m_Nodes[farIndex].bounds, ray.origin, invDirection, ray.min, tMax) };
+				if (tFar < tNear)
+				{
+					std::swap(nearIndex, farIndex);
+					std::swap(tNear, tFar);
+				}
+
+				if (tNear != FLT_MAX)
+				{
+					if (tFar != FLT_MAX)
+						stack[stackSize++] = farIndex;
+
+					nodeIndex = nearIndex;
+					continue;
+				}
+			}
+
+			//Pop the next node that is still in front of the closest hit
+			bool foundNode{ false };
+			while (stackSize > 0)
+			{
+				nodeIndex = stack[--stackSize];
+				RAYTRACER_STATS_ONLY(++nodeTests);
+				if (HitTest_AABB(m_Nodes[nodeIndex].bounds, ray.origin, invDirection, ray.min, tMax) != FLT_MAX)
+				{
+					foundNode = true;
+					break;
+				}
+			}
+
+			if (!foundNode)
+				return;
+		}
+	}
+
+	template<typename LeafFunc>
+	void BVH::TraversePacket(RayPacket& packet, LeafFunc&& onLeaf) const
+	{
+		if (m_Nodes.empty())
+			return;
+
+		//A packet test counts once for every lane it covers
+		RAYTRACER_STATS_ONLY(const uint64_t laneCount{ static_cast<uint64_t>(std::popcount(static_cast<unsigned int>(packet.GetActiveMask()))) });
+		RAYTRACER_STATS_ONLY(uint64_t& nodeTests{ Statistics::GetCounters().nodeTests });
+
+		SimdFloat tNear{};
+		RAYTRACER_STATS_ONLY(nodeTests += laneCount);
+		if (HitTest_AABB(m_Nodes[0].bounds, packet, tNear) == 0)
+			return;
+
+		uint32_t stack[64];
+		uint32_t stackSize{};
+		uint32_t nodeIndex{};
+
+		while (true)
+		{
+			const BVHNode& node{ m_Nodes[nodeIndex] };
+			if (node.IsLeaf())
+			{
+				onLeaf(node.leftFirst, node.primitiveCount);
+			}
+			else
+			{
+				//Visit the child the packet enters first (closest lane), push the other one
+				uint32_t nearIndex{ node.leftFirst };
+				uint32_t farIndex{ node.leftFirst + 1 };
+				SimdFloat tNearLeft{};
+				SimdFloat tNearRight{};
+				RAYTRACER_STATS_ONLY(nodeTests += 2 * laneCount);
+				const int leftMask{ HitTest_AABB(m_Nodes[nearIndex].bounds, packet, tNearLeft) };
+				const int rightMask{ HitTest_AABB(m_Nodes[farIndex].bounds, packet, tNearRight) };
+
+				if (leftMask != 0 && rightMask != 0)
+				{
+					//Order by the first lane that enters both children (coherent packets agree on the order)
+					const int bothMask{ leftMask & rightMask };
+					if (bothMask != 0)
+					{
+						const int lane{ std::countr_zero(static_cast<unsigned int>(bothMask)) };
+						if (tNearRight[lane] < tNearLeft[lane])
+							std::swap(nearIndex, farIndex);
+					}
+
+					stack[stackSize++] = farIndex;
+					nodeIndex = nearIndex;
+					continue;
+				}
+				if (leftMask != 0 || rightMask != 0)
+				{
+					nodeIndex = leftMask != 0 ? nearIndex : farIndex;
+					continue;
+				}
+			}
+
+			//Pop the next node that some lane can still hit in front of its closest hit
+			bool foundNode{ false };
+			while (stackSize > 0)
+			{
+				nodeIndex = stack[--stackSize];
+				RAYTRACER_STATS_ONLY(nodeTests += laneCount);
+				if (HitTest_AABB(m_Nodes[nodeIndex].bounds, packet, tNear) != 0)
+				{
+					foundNode = true;
+					break;
+				}
+			}
+
+			if (!foundNode)
+				return;
+		}
+	}
+#pragma endregion
+}
@@ -0,0 +1,408 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Simd.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		namespace
+		{
+			struct SuiteScene
+			{
+				const char* name{};
+				Scene* (*create)(){};
+			};
+
+			//Nearest rank percentile, samples must be sorted
+			double GetPercentile(const std::vector<double>& samples, double percentile)
+			{
+				const size_t rank{ static_cast<size_t>(std::ceil(percentile / 100.0 * samples.size())) };
+				return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+			}
+
+			//FNV-1a over the framebuffer, a changed hash means the image changed
+			uint64_t HashImage(const uint32_t* pPixels, size_t pixelCount)
+			{
+				uint64_t hash{ 14695981039346656037ull };
+				for (size_t i{}; i < pixelCount; ++i)
+				{
+					for (int byte{}; byte < 4; ++byte)
+					{
+						hash ^= (pPixels[i] >> (8 * byte)) & 0xFF;
+						hash *= 1099511628211ull;
+					}
+				}
+				return hash;
+			}
+		}
+
+		void RunBVHScaling(std::ostream& output)
+		{
+			using Clock = std::chrono::steady_clock;
+			constexpr size_t rayCount{ 500'000 };
+			constexpr size_t primitiveCounts[]{ 10, 100, 1'000, 10'000, 100'000, 1'000'000 };
+
+			//Same random rays for every scene: from the camera towards points inside the box
+			std::mt19937 generator{ 42 };
+			std::uniform_real_distribution<float> target{ -50.f, 50.f };
+			std::vector<Ray> rays{};
+			rays.reserve(rayCount);
+			const Vector3 rayOrigin{ 0.f, 0.f, -100.f };
+			for (size_t i{}; i < rayCount; ++i)
+			{
+				const Vector3 direction{ Vector3{ target(generator), target(generator), target(generator) } - rayOrigin };
+				rays.push_back({ rayOrigin, direction.Normalized() });
+			}
+
+			output << std::setw(12) << "primitives"
+				<< std::setw(14) << "build (ms)"
+				<< std::setw(18) << "closest (Mray/s)"
+				<< std::setw(18) << "shadow (Mray/s)"
+				<< std::setw(10) << "hit %"
+				<< std::setw(12) << "occluded %" << '\n';
+
+			for (const size_t primitiveCount : primitiveCounts)
+			{
+				Scene_BVHBenchmark scene{ primitiveCount };
+				scene.Initialize();
+
+				const auto buildStart{ Clock::now() };
+				scene.BuildAccelerationStructure();
+				const std::chrono::duration<double, std::milli> buildTime{ Clock::now() - buildStart };
+
+				size_t hitCount{};
+				const auto closestStart{ Clock::now() };
+				for (const Ray& ray : rays)
+				{
+					HitRecord closestHit{};
+					scene.GetClosestHit(ray, closestHit);
+					hitCount += closestHit.didHit;
+				}
+				const std::chrono::duration<double> closestTime{ Clock::now() - closestStart };
+
+				//Shadow rays stop halfway the box
+				size_t occludedCount{};
+				const auto shadowStart{ Clock::now() };
+				for (Ray ray : rays)
+				{
+					ray.max = 100.f;
+					occludedCount += scene.DoesHit(ray);
+				}
+				const std::chrono::duration<double> shadowTime{ Clock::now() - shadowStart };
+
+				output << std::fixed << std::setprecision(2)
+					<< std::setw(12) << primitiveCount
+					<< std::setw(14) << buildTime.count()
+					<< std::setw(18) << rayCount / closestTime.count() * 1e-6
+					<< std::setw(18) << rayCount / shadowTime.count() * 1e-6
+					<< std::setw(10) << 100.0 * hitCount / rayCount
+					<< std::setw(12) << 100.0 * occludedCount / rayCount << '\n';
+			}
+		}
+
+		bool RunObjLoading(const std::string& path, uint32_t threadCount, std::ostream& output)
+		{
+			constexpr int runCount{ 3 };
+
+			output << std::setw(12) << "mode"
+				<< std::setw(6) << "run"
+				<< std::setw(12) << "MB"
+				<< std::setw(12) << "vertices"
+				<< std::setw(12) << "triangles"
+				<< std::setw(10) << "threads"
+				<< std::setw(10) << "chunks"
+				<< std::setw(12) << "time (ms)"
+				<< std::setw(10) << "MB/s" << '\n';
+
+			ThreadPool threadPool{ threadCount };
+			std::vector<Vector3> positions{};
+			std::vector<Vector3> normals{};
+			std::vector<int> indices{};
+			for (int run{}; run < runCount; ++run)
+			{
+				ObjLoader::LoadStats stats{};
+				if (!ObjLoader::Load(path, positions, normals, indices, &threadPool, &stats))
+				{
+					output << "Could not load " << path << '\n';
+					return false;
+				}
+
+				output << std::fixed << std::setprecision(2)
+					<< std::setw(12) << "parse"
+					<< std::setw(6) << run
+					<< std::setw(12) << stats.byteCount * 1e-6
+					<< std::setw(12) << stats.vertexCount
+					<< std::setw(12) << stats.triangleCount
+					<< std::setw(10) << stats.threadCount
+					<< std::setw(10) << stats.chunkCount
+					<< std::setw(12) << stats.milliseconds
+					<< std::setw(10) << stats.GetMegabytesPerSecond() << '\n';
+			}
+
+			//Through the mesh cache next to the file: the first run writes it unless it is there already, BVH build included
+			for (int run{}; run < runCount; ++run)
+			{
+				TriangleMesh mesh{};
+				MeshCache::LoadStats stats{};
+				if (!MeshCache::LoadOBJ(path, mesh, {}, &threadPool, &stats))
+				{
+					output << "Could not load " << path << '\n';
+					return false;
+				}
+
+				output << std::fixed << std::setprecision(2)
+					<< std::setw(12) << (stats.isCacheHit ? "cache hit" : "cache miss")
+					<< std::setw(6) << run
+					<< std::setw(12) << stats.sourceByteCount * 1e-6
+					<< std::setw(12) << mesh.positions.size()
+					<< std::setw(12) << stats.triangleCount
+					<< std::setw(10) << "-"
+					<< std::setw(10) << "-"
+					<< std::setw(12) << stats.milliseconds
+					<< std::setw(10) << stats.sourceByteCount / (stats.milliseconds * 1e3)
+					<< "  (hash " << stats.hashMilliseconds << " ms";
+				if (!stats.isCacheHit)
+					output << ", bvh " << stats.bvhMilliseconds << " ms";
+				output << ")\n";
+			}
+			return true;
+		}
+
+		void RunBVHBuild(uint32_t threadCount, std::ostream& output)
+		{
+			constexpr size_t primitiveCounts[]{ 100'000, 1'000'000, 10'000'000 };
+
+			ThreadPool threadPool{ threadCount };
+
+			output << std::setw(12) << "primitives"
+				<< std::setw(10) << "threads"
+				<< std::setw(14) << "build (ms)"
+				<< std::setw(10) << "Mprim/s"
+				<< std::setw(13) << "large nodes"
+				<< std::setw(10) << "subtrees"
+				<< std::setw(12) << "nodes"
+				<< std::setw(16) << "same as serial" << '\n';
+
+			for (const size_t primitiveCount : primitiveCounts)
+			{
+				//Triangle soup bounds: small boxes of random size anywhere in a 100 unit cube
+				std::mt19937 generator{ 42 };
+				std::uniform_real_distribution<float> position{ -50.f, 50.f };
+				std::uniform_real_distribution<float> size{ 0.f, 1.f };
+				std::vector<AABB> primitiveBounds(primitiveCount);
+				for (AABB& bounds : primitiveBounds)
+				{
+					bounds.min = { position(generator), position(generator), position(generator) };
+					bounds.max = bounds.min + Vector3{ size(generator), size(generator), size(generator) };
+				}
+
+				//Serial first, the parallel build has to give the same tree
+				BVH serialBVH{};
+				BVH::BuildStats serialStats{};
+				serialBVH.Build(primitiveBounds, nullptr, &serialStats);
+
+				BVH parallelBVH{};
+				BVH::BuildStats parallelStats{};
+				parallelBVH.Build(primitiveBounds, &threadPool, &parallelStats);
+
+				const std::vector<BVHNode>& serialNodes{ serialBVH.GetNodes() };
+				const std::vector<BVHNode>& parallelNodes{ parallelBVH.GetNodes() };
+				const bool isSame{ serialNodes.size() == parallelNodes.size()
+					&& std::memcmp(serialNodes.data(), parallelNodes.data(), serialNodes.size() * sizeof(BVHNode)) == 0
+					&& serialBVH.GetPrimitiveIndices() == parallelBVH.GetPrimitiveIndices() };
+
+				for (const BVH::BuildStats* pStats : { &serialStats, &parallelStats })
+				{
+					const BVH::BuildStats& stats{ *pStats };
+					output << std::fixed << std::setprecision(2)
+						<< std::setw(12) << primitiveCount
+						<< std::setw(10) << stats.threadCount
+						<< std::setw(14) << stats.milliseconds
+						<< std::setw(10) << primitiveCount / (stats.milliseconds * 1e3)
+						<< std::setw(13) << stats.largeNodeCount
+						<< std::setw(10) << stats.subtreeCount
+						<< std::setw(12) << stats.nodeCount
+						<< std::setw(16) << (pStats == &serialStats ? "-" : (isSame ? "yes" : "NO")) << '\n';
+				}
+			}
+		}
+
+		void RunRefit(uint32_t threadCount, std::ostream& output)
+		{
+			using Clock = std::chrono::steady_clock;
+			constexpr int frameCount{ 300 };
+			constexpr float frameTime{ 1.f / 30.f };
+			constexpr int instancesPerAxis[]{ 32, 128, 256 };
+
+			ThreadPool threadPool{ threadCount };
+
+			output << std::setw(12) << "instances"
+				<< std::setw(8) << "frames"
+				<< std::setw(8) << "refits"
+				<< std::setw(10) << "rebuilds"
+				<< std::setw(12) << "refit (ms)"
+				<< std::setw(14) << "rebuild (ms)"
+				<< std::setw(13) << "update (ms)"
+				<< std::setw(16) << "max cost ratio" << '\n';
+
+			for (const int perAxis : instancesPerAxis)
+			{
+				Scene_MeshInstances scene{ perAxis };
+				scene.Initialize();
+				scene.BuildAccelerationStructure(&threadPool);
+
+				//Whole per frame update: instance transforms, refit and the rebuilds it triggers
+				double updateTime{};
+				float maxCostRatio{ 1.f };
+				for (int frame{ 1 }; frame <= frameCount; ++frame)
+				{
+					scene.Animate(frame * frameTime);
+
+					const auto updateStart{ Clock::now() };
+					scene.UpdateAccelerationStructure(&threadPool);
+					updateTime += std::chrono::duration<double, std::milli>(Clock::now() - updateStart).count();
+
+					maxCostRatio = std::max(maxCostRatio, scene.GetAccelerationStructureStats().costRatio);
+				}
+
+				//The first build is in the rebuild time as well, it is what a rebuild every frame would cost
+				const AccelerationStructureStats& stats{ scene.GetAccelerationStructureStats() };
+				output << std::fixed << std::setprecision(3)
+					<< std::setw(12) << perAxis * perAxis
+					<< std::setw(8) << frameCount
+					<< std::setw(8) << stats.refitCount
+					<< std::setw(10) << stats.rebuildCount - 1
+					<< std::setw(12) << stats.totalRefitMs / std::max<uint64_t>(stats.refitCount, 1)
+					<< std::setw(14) << stats.totalRebuildMs / stats.rebuildCount
+					<< std::setw(13) << updateTime / frameCount
+					<< std::setw(16) << maxCostRatio << '\n';
+			}
+		}
+
+		void RunSuite(const SuiteOptions& options, std::ostream& output, std::ostream& progress)
+		{
+			using Clock = std::chrono::steady_clock;
+
+			const SuiteScene scenes[]{
+				{ "W1", [] { return CreateScene("W1"); } },
+				{ "W2", [] { return CreateScene("W2"); } },
+				{ "W3", [] { return CreateScene("W3"); } },
+				{ "W4", [] { return CreateScene("W4"); } },
+				{ "SphereGrid_4k", []() -> Scene* { return new Scene_SphereGrid(16); } },
+				{ "SphereGrid_32k", []() -> Scene* { return new Scene_SphereGrid(32); } },
+				{ "TriangleSoup_10k", []() -> Scene* { return new Scene_TriangleSoup(10'000); } },
+				{ "TriangleSoup_100k", []() -> Scene* { return new Scene_TriangleSoup(100'000); } },
+				{ "ManyLights_8", []() -> Scene* { return new Scene_ManyLights(8); } },
+				{ "ManyLights_32", []() -> Scene* { return new Scene_ManyLights(32); } },
+				{ "MeshInstances_1k", []() -> Scene* { return new Scene_MeshInstances(32); } },
+				{ "MeshInstances_16k", []() -> Scene* { return new Scene_MeshInstances(128); } } };
+
+			const auto pRenderer = new Renderer(options.width, options.height, options.threadCount);
+			const size_t pixelCount{ static_cast<size_t>(options.width) * options.height };
+
+			output << std::fixed << std::setprecision(3)
+				<< "{\n"
+				<< "  \"width\": " << options.width << ",\n"
+				<< "  \"height\": " << options.height << ",\n"
+				<< "  \"warmUpFrames\": " << options.warmUpFrameCount << ",\n"
+				<< "  \"frames\": " << options.frameCount << ",\n"
+				<< "  \"threads\": " << pRenderer->GetThreadCount() << ",\n"
+				<< "  \"simdWidth\": " << SIMD_WIDTH << ",\n"
+				<< "  \"scenes\": [";
+
+			bool isFirstScene{ true };
+			for (const SuiteScene& suiteScene : scenes)
+			{
+				if (std::string{ suiteScene.name }.find(options.sceneFilter) == std::string::npos)
+					continue;
+
+				progress << "Benchmarking " << suiteScene.name << "..." << std::endl;
+
+				Scene* pScene{ suiteScene.create() };
+				pScene->Initialize();
+
+				//Built on the render threads, the way RayTracer builds its scenes
+				const auto buildStart{ Clock::now() };
+				pScene->BuildAccelerationStructure(pRenderer->GetThreadPool());
+				const std::chrono::duration<double, std::milli> buildTime{ Clock::now() - buildStart };
+
+				//The scene never changes, every frame is invalidated so it is traced instead of only presented
+				for (int frame{}; frame < options.warmUpFrameCount; ++frame)
+				{
+					pRenderer->Invalidate();
+					pRenderer->Render(pScene);
+				}
+
+				//Nothing moves, every measured frame traces exactly the same rays
+				Statistics::Reset();
+				std::vector<double> frameTimes{};
+				frameTimes.reserve(options.frameCount);
+				for (int frame{}; frame < options.frameCount; ++frame)
+				{
+					pRenderer->Invalidate();
+					const auto frameStart{ Clock::now() };
+					pRenderer->Render(pScene);
+					frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+				}
+				const TraceCounters counters{ Statistics::Collect() };
+
+				double totalTime{};
+				for (const double frameTime : frameTimes)
+				{
+					totalTime += frameTime;
+				}
+				std::sort(frameTimes.begin(), frameTimes.end());
+
+				const double frameCount{ static_cast<double>(options.frameCount) };
+				[[maybe_unused]] const double rayCount{ static_cast<double>(std::max<uint64_t>(counters.GetRayCount(), 1)) }; //Only read in RAYTRACER_STATS builds
+
+				output << (isFirstScene ? "\n" : ",\n")
+					<< "    {\n"
+					<< "      \"name\": \"" << suiteScene.name << "\",\n"
+					<< "      \"buildMs\": " << buildTime.count() << ",\n"
+					<< "      \"msPerFrame\": { \"mean\": " << totalTime / frameCount
+					<< ", \"min\": " << frameTimes.front()
+					<< ", \"p50\": " << GetPercentile(frameTimes, 50.0)
+					<< ", \"p90\": " << GetPercentile(frameTimes, 90.0)
+					<< ", \"p99\": " << GetPercentile(frameTimes, 99.0)
+					<< ", \"max\": " << frameTimes.back() << " },\n"
+					<< "      \"mraysPerSecond\": " << counters.GetRayCount() / totalTime * 1e-3 << ",\n"
+					<< "      \"primaryRaysPerFrame\": " << static_cast<uint64_t>(counters.closestHitRays / frameCount) << ",\n"
+					<< "      \"shadowRaysPerFrame\": " << static_cast<uint64_t>(counters.anyHitRays / frameCount) << ",\n"
+#ifdef RAYTRACER_STATS
+					<< "      \"nodeTestsPerRay\": " << counters.nodeTests / rayCount << ",\n"
+					<< "      \"primitiveTestsPerRay\": " << counters.primitiveTests / rayCount << ",\n"
+#else
+					//Not counted without RAYTRACER_STATS
+					<< "      \"nodeTestsPerRay\": null,\n"
+					<< "      \"primitiveTestsPerRay\": null,\n"
+#endif
+					<< "      \"imageHash\": \"" << std::hex << std::setw(16) << std::setfill('0')
+					<< HashImage(pRenderer->GetBuffer(), pixelCount) << std::dec << std::setfill(' ') << "\"\n"
+					<< "    }";
+				isFirstScene = false;
+
+				delete pScene;
+			}
+
+			output << "\n  ]\n}" << std::endl;
+
+			delete pRenderer;
+		}
+	}
+}
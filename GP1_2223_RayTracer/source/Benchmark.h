@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		/**
+		 * \brief Measures BVH build time and closest-hit / shadow rays per second for 10 up to 1M primitives
+		 * \param output stream the result table is written to
+		 */
+		void RunBVHScaling(std::ostream& output = std::cout);
+
+		/**
+		 * \brief Loads an OBJ file a few times with ObjLoader, then through the mesh cache (BVH included), and writes the load time
+		 * and throughput (MB/s of OBJ text) of every run. The first run includes reading the file from disk unless the OS still caches it
+		 * \param path OBJ file
+		 * \param threadCount parse threads, 0 uses every hardware thread
+		 * \param output stream the result table is written to
+		 * \return false when the file could not be loaded
+		 */
+		bool RunObjLoading(const std::string& path, uint32_t threadCount, std::ostream& output = std::cout);
+
+		/**
+		 * \brief Builds BVHs over 100k up to 10M random triangle bounds on the calling thread and on a thread pool, writes the build
+		 * time and throughput of both, how the parallel build split the work (see BVH::BuildStats) and whether it gave the same tree
+		 * \param threadCount threads of the parallel build, 0 uses every hardware thread
+		 * \param output stream the result table is written to
+		 */
+		void RunBVHBuild(uint32_t threadCount, std::ostream& output = std::cout);
+
+		/**
+		 * \brief Animates the rocks of Scene_MeshInstances for a few seconds at 30 frames per second and writes how the top level
+		 * BVH kept up (see AccelerationStructureStats): refits and rebuilds with their mean times, the mean time of the whole
+		 * per frame update and how far the tree degraded
+		 * \param threadCount threads of the update, 0 uses every hardware thread
+		 * \param output stream the result table is written to
+		 */
+		void RunRefit(uint32_t threadCount, std::ostream& output = std::cout);
+
+		//Settings of the render benchmark suite, every scene renders with the same settings
+		struct SuiteOptions
+		{
+			int width{ 640 };
+			int height{ 480 };
+			int warmUpFrameCount{ 1 }; //Not measured, also lets the renderer measure its tile costs
+			int frameCount{ 8 };
+			uint32_t threadCount{}; //0 = every hardware thread
+			std::string sceneFilter{}; //Only scenes whose name contains this run, empty runs all of them
+		};
+
+		/**
+		 * \brief Renders the built-in scenes and the stress scenes headless and writes the results as JSON:
+		 * the acceleration structure build time (on the render threads), ms/frame percentiles, Mrays/s, BVH node and primitive tests per ray (RAYTRACER_STATS builds, null otherwise) and a hash of the final image
+		 * \param options resolution, frame counts and scene filter
+		 * \param output stream the JSON document is written to
+		 * \param progress stream the per scene progress is written to
+		 */
+		void RunSuite(const SuiteOptions& options, std::ostream& output = std::cout, std::ostream& progress = std::cerr);
+
+		//Settings of the kernel micro-benchmarks
+		struct MicroOptions
+		{
+			int warmUpRepetitionCount{ 3 }; //Not measured
+			int repetitionCount{ 15 };
+			int callCount{ 1'000'000 }; //Calls per repetition
+			std::string kernelFilter{}; //Only kernels whose name contains this run, empty runs all of them
+		};
+
+		/**
+		 * \brief Validates the compiled shading kernels, then times the inner kernels (GeometryUtils hit tests, BRDF terms, Matrix and Vector3 math) one by one on random inputs,
+		 * writes ns/call (mean, standard deviation, min, median) and calls per second of every kernel as a table
+		 * \param options repetitions, calls per repetition and kernel filter
+		 * \param output stream the result table is written to
+		 * \return false when a compiled shading kernel is further than the stated error bound from its BRDF:: reference
+		 */
+		bool RunMicroBenchmarks(const MicroOptions& options, std::ostream& output = std::cout);
+	}
+}
@@ -0,0 +1,81 @@
+//Standard includes
+#include <fstream>
+#include <iostream>
+#include <string>
+
+//Project includes
+#include "Benchmark.h"
+#include "CommandLine.h"
+
+using namespace dae;
+
+int main(int argc, char* args[])
+{
+	Benchmark::SuiteOptions options{};
+	std::string outputPath{};
+	std::string objPath{};
+	bool isBVHRun{ false };
+	bool isRefitRun{ false };
+	bool isBVHBuildRun{ false };
+	int threadCount{};
+
+	CommandLine commandLine{ "RayTracerBenchmark" };
+	commandLine.AddInt("--width", "pixels", "default 640", 1, options.width);
+	commandLine.AddInt("--height", "pixels", "default 480", 1, options.height);
+	commandLine.AddInt("--warmup", "count", "unmeasured frames per scene, default 1", 0, options.warmUpFrameCount);
+	commandLine.AddInt("--frames", "count", "measured frames per scene, default 8", 1, options.frameCount);
+	commandLine.AddInt("--threads", "count", "render threads, default 0 (all hardware threads)", 0, threadCount);
+	commandLine.AddString("--scene", "filter", "only run the scenes whose name contains filter", options.sceneFilter);
+	commandLine.AddString("--output", "path", "write the JSON results to a file instead of stdout", outputPath);
+	commandLine.AddFlag("--bvh", "run the BVH scaling benchmark instead", isBVHRun);
+	commandLine.AddFlag("--bvh-build", "time serial against parallel BVH builds of up to 10M primitives instead (uses --threads)", isBVHBuildRun);
+	commandLine.AddFlag("--refit", "time the top level BVH refits of animated mesh instances instead (uses --threads)", isRefitRun);
+	commandLine.AddString("--obj", "path", "time loading an OBJ file and its mesh cache instead (uses --threads)", objPath);
+	switch (commandLine.Parse(argc, args))
+	{
+	case CommandLine::ParseResult::Help:
+		return 0;
+	case CommandLine::ParseResult::Error:
+		return 1;
+	case CommandLine::ParseResult::Run:
+		break;
+	}
+	options.threadCount = static_cast<uint32_t>(threadCount);
+
+	if (isBVHRun)
+	{
+		Benchmark::RunBVHScaling();
+		return 0;
+	}
+
+	if (!objPath.empty())
+		return Benchmark::RunObjLoading(objPath, options.threadCount) ? 0 : 1;
+
+	if (isBVHBuildRun)
+	{
+		Benchmark::RunBVHBuild(options.threadCount);
+		return 0;
+	}
+
+	if (isRefitRun)
+	{
+		Benchmark::RunRefit(options.threadCount);
+		return 0;
+	}
+
+	if (outputPath.empty())
+	{
+		Benchmark::RunSuite(options);
+		return 0;
+	}
+
+	std::ofstream file{ outputPath };
+	if (!file)
+	{
+		std::cout << "Could not open " << outputPath << std::endl;
+		return 1;
+	}
+	Benchmark::RunSuite(options, file);
+	std::cout << "Saved " << outputPath << std::endl;
+	return 0;
+}
@@ -1,13 +1,22 @@
 #pragma once
 #include <cassert>
+#ifndef RAYTRACER_HEADLESS
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
+#endif
 
 #include "Math.h"
 #include "Timer.h"
 
 namespace dae
 {
+	enum class ProjectionType
+	{
+		Pinhole,
+		Orthographic,
+		ThinLens //Depth of field, builds up over the samples of progressive mode
+	};
+
 	struct Camera
 	{
 		Camera() = default;
@@ -21,6 +30,11 @@ namespace dae
 
 		Vector3 origin{ };
 		float fovAngle{90.f};
+
+		ProjectionType projection{ ProjectionType::Pinhole };
+		float orthographicSize{ 5.f }; //Orthographic: half the visible height in world units
+		float apertureRadius{ .1f }; //Thin lens
+		float focusDistance{ 9.f }; //Thin lens: distance along forward that stays sharp
 		float pitch{ 0 };
 		float yaw{ 0 };
 
@@ -33,11 +47,34 @@ namespace dae
 
 		Matrix cameraToWorld{};
 
+		//Set when Update moved or turned the camera, the renderer clears it once it restarted its image
+		//Set it after changing origin or fovAngle directly
+		bool hasMoved{ true };
+		//forward/right/up still have to be built from pitch and yaw
+		bool isRotationDirty{ true };
+
 		const float moveStep = 1.f;
 		const float rotateStep = 0.1f;
 		const int mouseThreshold = 2;
 
-		Matrix CalculateCameraToWorld()
+		void CycleProjection()
+		{
+			switch (projection)
+			{
+			case ProjectionType::Pinhole:
+				projection = ProjectionType::Orthographic;
+				break;
+			case ProjectionType::Orthographic:
+				projection = ProjectionType::ThinLens;
+				break;
+			case ProjectionType::ThinLens:
+				projection = ProjectionType::Pinhole;
+				break;
+			}
+			hasMoved = true;
+		}
+
+		Matrix CalculateCameraToWorld() const
 		{
 			//todo: W2
 			Vector4 t{ origin, 1.f };
@@ -46,8 +83,13 @@ namespace dae
 			return cam;
 		}
 
-		void Update(Timer* pTimer)
+		void Update([[maybe_unused]] Timer* pTimer) //Only read by the window input
 		{
+			const Vector3 previousOrigin{ origin };
+			const float previousPitch{ pitch };
+			const float previousYaw{ yaw };
+
+#ifndef RAYTRACER_HEADLESS
 			const float deltaTime = pTimer->GetElapsed();
 
 			//Keyboard Input
@@ -120,16 +162,27 @@ namespace dae
 					pitch -= rotateStep;
 				}
 			}
+#endif
+
+			//The basis only changes with the rotation, idle frames skip the matrix math
+			if (isRotationDirty || pitch != previousPitch || yaw != previousYaw)
+			{
+				Matrix pitchRotation =  Matrix::CreateRotationX(pitch);
+				Matrix yawRotation = Matrix::CreateRotationY(yaw);
+				Matrix finalRotation = yawRotation * pitchRotation;
+				forward = finalRotation.TransformVector(Vector3::UnitZ);
+				forward.Normalize();
+				right = finalRotation.TransformVector(Vector3::UnitX);
+				right.Normalize();
+				up = finalRotation.TransformVector(Vector3::UnitY);
+				up.Normalize();
+
+				isRotationDirty = false;
+				hasMoved = true;
+			}
 
-			Matrix pitchRotation =  Matrix::CreateRotationX(pitch);
-			Matrix yawRotation = Matrix::CreateRotationY(yaw);
-			Matrix finalRotation = yawRotation * pitchRotation;
-			forward = finalRotation.TransformVector(Vector3::UnitZ);
-			forward.Normalize();
-			right = finalRotation.TransformVector(Vector3::UnitX);
-			right.Normalize();
-			up = finalRotation.TransformVector(Vector3::UnitY);
-			up.Normalize();
+			if (origin.x != previousOrigin.x || origin.y != previousOrigin.y || origin.z != previousOrigin.z)
+				hasMoved = true;
 		}
 	};
 }
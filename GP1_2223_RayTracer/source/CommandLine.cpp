@@ -0,0 +1,125 @@
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+
+namespace dae
+{
+	namespace
+	{
+		const std::string g_HelpName{ "--help, -h" };
+		const std::string g_HelpDescription{ "print this usage and exit" };
+
+		bool ParseInt(const char* pText, int minValue, int& value)
+		{
+			char* pEnd{};
+			const long result{ std::strtol(pText, &pEnd, 10) };
+			if (pEnd == pText || *pEnd != '\0' || result < minValue || result > INT_MAX)
+				return false;
+
+			value = static_cast<int>(result);
+			return true;
+		}
+	}
+
+	CommandLine::CommandLine(const std::string& programName) :
+		m_ProgramName{ programName }
+	{
+	}
+
+	void CommandLine::AddFlag(const std::string& name, const std::string& description, bool& isSet)
+	{
+		m_Options.push_back({ name, {}, description, [&isSet](const char*) { isSet = true; return true; } });
+	}
+
+	void CommandLine::AddInt(const std::string& name, const std::string& valueName, const std::string& description, int minValue, int& value)
+	{
+		AddValue(name, valueName, description, [minValue, &value](const char* pValue) { return ParseInt(pValue, minValue, value); });
+	}
+
+	void CommandLine::AddString(const std::string& name, const std::string& valueName, const std::string& description, std::string& value)
+	{
+		AddValue(name, valueName, description, [&value](const char* pValue) { value = pValue; return true; });
+	}
+
+	void CommandLine::AddValue(const std::string& name, const std::string& valueName, const std::string& description,
+		const std::function<bool(const char*)>& parse)
+	{
+		m_Options.push_back({ name, valueName, description, parse });
+	}
+
+	CommandLine::ParseResult CommandLine::Parse(int argc, char* args[]) const
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			const std::string name{ args[i] };
+			if (name == "--help" || name == "-h")
+			{
+				PrintUsage();
+				return ParseResult::Help;
+			}
+
+			//The name is checked first, so an unknown option never takes the next argument as its value
+			const Option* pOption{ FindOption(name) };
+			if (!pOption)
+			{
+				std::cout << "Unknown option " << name << std::endl;
+				PrintUsage();
+				return ParseResult::Error;
+			}
+
+			if (pOption->valueName.empty())
+			{
+				pOption->parse(nullptr);
+				continue;
+			}
+
+			if (i + 1 >= argc)
+			{
+				std::cout << "Missing value for " << name << std::endl;
+				PrintUsage();
+				return ParseResult::Error;
+			}
+			const char* pValue{ args[++i] };
+			if (!pOption->parse(pValue))
+			{
+				std::cout << "Invalid value for " << name << ": " << pValue << std::endl;
+				PrintUsage();
+				return ParseResult::Error;
+			}
+		}
+		return ParseResult::Run;
+	}
+
+	void CommandLine::PrintUsage() const
+	{
+		//Descriptions line up one column after the longest option
+		size_t columnWidth{ g_HelpName.size() };
+		for (const Option& option : m_Options)
+		{
+			columnWidth = std::max(columnWidth, option.name.size() + (option.valueName.empty() ? 0 : option.valueName.size() + 3));
+		}
+		columnWidth = std::max(columnWidth + 1, size_t{ 20 });
+
+		const auto printLine = [columnWidth](const std::string& left, const std::string& description)
+			{
+				std::cout << "  " << left << std::string(columnWidth - left.size(), ' ') << description << '\n';
+			};
+
+		std::cout << "Usage: " << m_ProgramName << " [options]\n";
+		for (const Option& option : m_Options)
+		{
+			printLine(option.valueName.empty() ? option.name : option.name + " <" + option.valueName + '>', option.description);
+		}
+		printLine(g_HelpName, g_HelpDescription);
+		std::cout << std::flush;
+	}
+
+	const CommandLine::Option* CommandLine::FindOption(const std::string& name) const
+	{
+		const auto it{ std::find_if(m_Options.begin(), m_Options.end(), [&name](const Option& option) { return option.name == name; }) };
+		return it != m_Options.end() ? &*it : nullptr;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	//Options of an executable, shared by RayTracer and the benchmark executables. Every option is optional,
+	//--help and -h are always known and print the usage
+	class CommandLine final
+	{
+	public:
+		enum class ParseResult
+		{
+			Run,
+			Help, //--help or -h, the usage was printed
+			Error //The reason and the usage were printed
+		};
+
+		explicit CommandLine(const std::string& programName);
+
+		//Option without a value, sets isSet when given
+		void AddFlag(const std::string& name, const std::string& description, bool& isSet);
+		//Whole number of at least minValue
+		void AddInt(const std::string& name, const std::string& valueName, const std::string& description, int minValue, int& value);
+		void AddString(const std::string& name, const std::string& valueName, const std::string& description, std::string& value);
+		//Any other value, parse returns false for a value it does not accept
+		void AddValue(const std::string& name, const std::string& valueName, const std::string& description,
+			const std::function<bool(const char*)>& parse);
+
+		/**
+		 * \brief Reads the options in order. An unknown option, a missing or an invalid value stops with Error
+		 * \return Run when every option was read, Help as soon as --help or -h is read
+		 */
+		ParseResult Parse(int argc, char* args[]) const;
+		void PrintUsage() const;
+
+	private:
+		struct Option
+		{
+			std::string name{};
+			std::string valueName{}; //Empty for flags
+			std::string description{};
+			std::function<bool(const char*)> parse{}; //Gets nullptr for flags
+		};
+
+		std::string m_ProgramName{};
+		std::vector<Option> m_Options{};
+
+		const Option* FindOption(const std::string& name) const;
+	};
+}
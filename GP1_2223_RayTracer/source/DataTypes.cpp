@@ -0,0 +1,121 @@
+#include "DataTypes.h"
+
+#include <numeric>
+
+#include "Simd.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Triangles per job of the parallel passes of BuildBVH
+		constexpr size_t g_BuildBlockSize{ 1 << 14 };
+
+		//Divides by the length like Vector3::Normalized
+		SimdVector3 Normalize(const SimdVector3& v)
+		{
+			const SimdFloat length{ SimdFloat::Sqrt(SimdVector3::Dot(v, v)) };
+			return { v.x / length, v.y / length, v.z / length };
+		}
+	}
+
+	void TriangleMesh::CalculateNormals()
+	{
+		const size_t triangleCount{ indices.size() / 3 };
+		normals.resize(triangleCount);
+
+		size_t i{};
+		for (; i + SIMD_WIDTH <= triangleCount; i += SIMD_WIDTH)
+		{
+			//The corners are gathered through the indices into three interleaved blocks, one per corner
+			alignas(SIMD_ALIGNMENT) Vector3 corners[3][SIMD_WIDTH];
+			for (int lane{}; lane < SIMD_WIDTH; ++lane)
+			{
+				const int* pTriangle{ &indices[3 * (i + lane)] };
+				corners[0][lane] = positions[pTriangle[0]];
+				corners[1][lane] = positions[pTriangle[1]];
+				corners[2][lane] = positions[pTriangle[2]];
+			}
+
+			const SimdVector3 v0{ SimdVector3::LoadInterleaved(&corners[0][0].x) };
+			const SimdVector3 edgeV0V1{ SimdVector3::LoadInterleaved(&corners[1][0].x) - v0 };
+			const SimdVector3 edgeV0V2{ SimdVector3::LoadInterleaved(&corners[2][0].x) - v0 };
+			Normalize(SimdVector3::Cross(edgeV0V1, edgeV0V2)).StoreInterleaved(&normals[i].x);
+		}
+
+		for (; i < triangleCount; ++i)
+		{
+			const Vector3& v0{ positions[indices[3 * i]] };
+			normals[i] = Vector3::Cross(positions[indices[3 * i + 1]] - v0, positions[indices[3 * i + 2]] - v0).Normalized();
+		}
+	}
+
+	void TriangleMesh::BuildBVH(ThreadPool* pThreadPool, BVH::BuildStats* pStats)
+	{
+		const size_t triangleCount{ indices.size() / 3 };
+
+		std::vector<AABB> triangleBounds(triangleCount);
+		ParallelForBlocks(pThreadPool, triangleCount, g_BuildBlockSize, [&](size_t first, size_t end)
+			{
+				for (size_t i{ first }; i < end; ++i)
+				{
+					AABB& bounds{ triangleBounds[i] };
+					bounds.Grow(positions[indices[3 * i]]);
+					bounds.Grow(positions[indices[3 * i + 1]]);
+					bounds.Grow(positions[indices[3 * i + 2]]);
+				}
+			});
+
+		bvh.Build(triangleBounds, pThreadPool, pStats);
+
+		//The faces are in source order until the first build (or were replaced as a whole)
+		if (sourceFaceIndices.size() != triangleCount)
+		{
+			sourceFaceIndices.resize(triangleCount);
+			std::iota(sourceFaceIndices.begin(), sourceFaceIndices.end(), 0u);
+		}
+
+		//Reorder the triangles in leaf order, so traversal reads them sequentially
+		const std::vector<uint32_t>& triangleOrder{ bvh.GetPrimitiveIndices() };
+		std::vector<int> orderedIndices(indices.size());
+		std::vector<Vector3> orderedNormals(normals.size());
+		std::vector<uint32_t> orderedSourceFaceIndices(triangleCount);
+		precomputedTriangles.resize(triangleCount);
+		ParallelForBlocks(pThreadPool, triangleOrder.size(), g_BuildBlockSize, [&](size_t first, size_t end)
+			{
+				for (size_t i{ first }; i < end; ++i)
+				{
+					const size_t triangle{ triangleOrder[i] };
+					orderedIndices[3 * i] = indices[3 * triangle];
+					orderedIndices[3 * i + 1] = indices[3 * triangle + 1];
+					orderedIndices[3 * i + 2] = indices[3 * triangle + 2];
+					orderedNormals[i] = normals[triangle];
+					orderedSourceFaceIndices[i] = sourceFaceIndices[triangle];
+
+					precomputedTriangles[i] = { positions[orderedIndices[3 * i]], positions[orderedIndices[3 * i + 1]], positions[orderedIndices[3 * i + 2]],
+						cullMode, static_cast<uint32_t>(i) };
+				}
+			});
+		indices = std::move(orderedIndices);
+		normals = std::move(orderedNormals);
+		sourceFaceIndices = std::move(orderedSourceFaceIndices);
+
+		isBVHDirty = false;
+	}
+
+	void TriangleMesh::UpdateTransforms()
+	{
+		if (isTransformDirty)
+		{
+			//Calculate Final Transform
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+			inverseTransform = Matrix::Inverse(worldTransform);
+			normalTransform = Matrix::Transpose(inverseTransform);
+			isTransformDirty = false;
+		}
+
+		//The BVH may have been rebuilt without the transform changing
+		worldBounds = GetTransformedBounds(bvh, worldTransform);
+	}
+}
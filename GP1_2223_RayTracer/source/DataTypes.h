@@ -2,6 +2,8 @@
 #include <cassert>
 
 #include "Math.h"
+#include "Ray.h"
+#include "BVH.h"
 #include "vector"
 
 namespace dae
@@ -12,7 +14,7 @@ namespace dae
 		Vector3 origin{};
 		float radius{};
 
-		unsigned char materialIndex{ 0 };
+		uint32_t materialIndex{ 0 };
 	};
 
 	struct Plane
@@ -20,7 +22,99 @@ namespace dae
 		Vector3 origin{};
 		Vector3 normal{};
 
-		unsigned char materialIndex{ 0 };
+		uint32_t materialIndex{ 0 };
+	};
+
+	//Spheres split into one array per component (structure of arrays), so SIMD_WIDTH spheres load with one instruction per component
+	//The arrays are aligned and padded by at least SIMD_WIDTH - 1 elements, so a load at any sphere never reads past the end
+	//Only what the hit tests read is stored, materials are looked up in a side table by the owner once the closest hit is known
+	struct SphereSoA
+	{
+		AlignedVector<float> originX{};
+		AlignedVector<float> originY{};
+		AlignedVector<float> originZ{};
+		AlignedVector<float> radius{};
+		size_t count{};
+
+		void Clear()
+		{
+			originX.clear();
+			originY.clear();
+			originZ.clear();
+			radius.clear();
+			count = 0;
+		}
+
+		void Add(const Sphere& sphere)
+		{
+			//Grow by a full register, the padding lanes are zero sized spheres at the world origin
+			if (count + SIMD_WIDTH > originX.size())
+			{
+				const size_t paddedSize{ originX.size() + SIMD_WIDTH };
+				originX.resize(paddedSize);
+				originY.resize(paddedSize);
+				originZ.resize(paddedSize);
+				radius.resize(paddedSize);
+			}
+
+			originX[count] = sphere.origin.x;
+			originY[count] = sphere.origin.y;
+			originZ[count] = sphere.origin.z;
+			radius[count] = sphere.radius;
+			++count;
+		}
+
+		//Geometry only, the material index is left at 0
+		Sphere GetSphere(size_t index) const
+		{
+			return Sphere{ { originX[index], originY[index], originZ[index] }, radius[index] };
+		}
+	};
+
+	//Planes split into one array per component, same layout rules as SphereSoA
+	struct PlaneSoA
+	{
+		AlignedVector<float> originX{};
+		AlignedVector<float> originY{};
+		AlignedVector<float> originZ{};
+		AlignedVector<float> normalX{};
+		AlignedVector<float> normalY{};
+		AlignedVector<float> normalZ{};
+		size_t count{};
+
+		void Clear()
+		{
+			originX.clear();
+			originY.clear();
+			originZ.clear();
+			normalX.clear();
+			normalY.clear();
+			normalZ.clear();
+			count = 0;
+		}
+
+		void Add(const Plane& plane)
+		{
+			//Padding lanes get a zero normal, they never face a ray
+			if (count + SIMD_WIDTH > originX.size())
+			{
+				const size_t paddedSize{ originX.size() + SIMD_WIDTH };
+				originX.resize(paddedSize);
+				originY.resize(paddedSize);
+				originZ.resize(paddedSize);
+				normalX.resize(paddedSize);
+				normalY.resize(paddedSize);
+				normalZ.resize(paddedSize);
+			}
+
+			originX[count] = plane.origin.x;
+			originY[count] = plane.origin.y;
+			originZ[count] = plane.origin.z;
+			normalX[count] = plane.normal.x;
+			normalY[count] = plane.normal.y;
+			normalZ[count] = plane.normal.z;
+			++count;
+		}
 	};
 
 	enum class TriangleCullMode
@@ -51,9 +145,46 @@ namespace dae
 		Vector3 normal{};
 
 		TriangleCullMode cullMode{};
-		unsigned char materialIndex{};
+		uint32_t materialIndex{};
 	};
 
+	//Intersection ready copy of a triangle (Moller-Trumbore), the edges are computed once instead of for every ray
+	//Shading data (normal, material) stays on the Triangle/TriangleMesh, triangleIndex points back to it
+	struct PrecomputedTriangle
+	{
+		PrecomputedTriangle() = default;
+		PrecomputedTriangle(const Vector3& _v0, const Vector3& _v1, const Vector3& _v2, TriangleCullMode _cullMode, uint32_t _triangleIndex) :
+			v0{ _v0 }, edge1{ _v1 - _v0 }, edge2{ _v2 - _v0 }, cullMode{ _cullMode }, triangleIndex{ _triangleIndex } {}
+
+		PrecomputedTriangle(const Triangle& triangle, uint32_t _triangleIndex) :
+			PrecomputedTriangle(triangle.v0, triangle.v1, triangle.v2, triangle.cullMode, _triangleIndex) {}
+
+		Vector3 v0{};
+		Vector3 edge1{}; //v1 - v0
+		Vector3 edge2{}; //v2 - v0
+
+		TriangleCullMode cullMode{};
+		uint32_t triangleIndex{};
+	};
+
+	//Bounds of the 8 transformed corners of the object space bounds of a BVH, empty for an empty BVH
+	inline AABB GetTransformedBounds(const BVH& bvh, const Matrix& transform)
+	{
+		AABB bounds{};
+		if (!bvh.IsEmpty())
+		{
+			const AABB& objectBounds{ bvh.GetBounds() };
+			for (int corner{}; corner < 8; ++corner)
+			{
+				bounds.Grow(transform.TransformPoint(
+					corner & 1 ? objectBounds.max.x : objectBounds.min.x,
+					corner & 2 ? objectBounds.max.y : objectBounds.min.y,
+					corner & 4 ? objectBounds.max.z : objectBounds.min.z));
+			}
+		}
+		return bounds;
+	}
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -62,21 +193,22 @@ namespace dae
 		{
 			//Calculate Normals
 			CalculateNormals();
-
-			//Update Transforms
-			UpdateTransforms();
 		}
 
 		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
-			positions(_positions), indices(_indices), normals(_normals), cullMode(_cullMode)
+			positions(_positions), normals(_normals), indices(_indices), cullMode(_cullMode)
 		{
-			UpdateTransforms();
 		}
 
 		std::vector<Vector3> positions{};
 		std::vector<Vector3> normals{};
 		std::vector<int> indices{};
-		unsigned char materialIndex{};
+		uint32_t materialIndex{}; //Of every face, unless faceMaterialIndices is used
+		//Optional material per face in source order (the order the faces were added in, BuildBVH does not reorder it),
+		//empty when the whole mesh uses materialIndex
+		std::vector<uint32_t> faceMaterialIndices{};
+		//Source order index of every face, leaf order like indices (written by BuildBVH)
+		std::vector<uint32_t> sourceFaceIndices{};
 
 		TriangleCullMode cullMode{TriangleCullMode::BackFaceCulling};
 
@@ -84,27 +216,46 @@ namespace dae
 		Matrix translationTransform{};
 		Matrix scaleTransform{};
 
-		std::vector<Vector3> transformedPositions{};
-		std::vector<Vector3> transformedNormals{};
+		//Cached by UpdateTransforms, rays are moved into object space instead of moving the vertices
+		Matrix worldTransform{};
+		Matrix inverseTransform{};
+		Matrix normalTransform{}; //Transposed inverse
+
+		//Transformed bounds of the BVH for the top level BVH, written by UpdateTransforms
+		AABB worldBounds{};
+
+		//Bottom level BVH over the triangles in object space, leaf ranges index triangles directly
+		BVH bvh{};
+		//Object space, leaf order (built with the BVH)
+		std::vector<PrecomputedTriangle> precomputedTriangles{};
+
+		//Set isTransformDirty after changing a transform matrix directly, isBVHDirty after editing positions or indices
+		bool isTransformDirty{ true };
+		bool isBVHDirty{ true };
 
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
+			isTransformDirty = true;
 		}
 
 		void RotateY(float yaw)
 		{
 			rotationTransform = Matrix::CreateRotationY(yaw);
+			isTransformDirty = true;
 		}
 
 		void Scale(const Vector3& scale)
 		{
 			scaleTransform = Matrix::CreateScale(scale);
+			isTransformDirty = true;
 		}
 
-		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
+		//Only stores the triangle, the BVH and world bounds catch up once in the next acceleration structure update
+		void AppendTriangle(const Triangle& triangle)
 		{
 			int startIndex = static_cast<int>(positions.size());
+			const size_t faceIndex{ indices.size() / 3 };
 
 			positions.push_back(triangle.v0);
 			positions.push_back(triangle.v1);
@@ -115,28 +266,105 @@ namespace dae
 			indices.push_back(++startIndex);
 
 			normals.push_back(triangle.normal);
+			if (!faceMaterialIndices.empty())
+				faceMaterialIndices.push_back(materialIndex);
+			//Appended faces keep their slot until the next build, which reorders them with the rest
+			if (sourceFaceIndices.size() == faceIndex)
+				sourceFaceIndices.push_back(static_cast<uint32_t>(faceIndex));
+			isBVHDirty = true;
+		}
 
-			//Not ideal, but making sure all vertices are updated
-			if(!ignoreTransformUpdate)
-				UpdateTransforms();
+		//Gives one face its own material, the other faces keep theirs. faceIndex is in source order, built or not
+		//(use Scene::SetFaceMaterial on a mesh of a scene, so the next frame shows it)
+		void SetFaceMaterial(size_t faceIndex, uint32_t faceMaterialIndex)
+		{
+			if (faceMaterialIndices.empty())
+				faceMaterialIndices.assign(indices.size() / 3, materialIndex);
+
+			faceMaterialIndices[faceIndex] = faceMaterialIndex;
+		}
+
+		//Material of a face (leaf order index, as reported by the hit tests)
+		uint32_t GetMaterialIndex(size_t triangleIndex) const
+		{
+			if (faceMaterialIndices.empty())
+				return materialIndex;
+
+			assert(sourceFaceIndices.size() == normals.size() && "BuildBVH was not called after changing the mesh");
+			return faceMaterialIndices[sourceFaceIndices[triangleIndex]];
+		}
+
+		//One normalized face normal per triangle, (v1 - v0) x (v2 - v0), SIMD_WIDTH triangles at a time
+		void CalculateNormals();
+
+		//Rebuilds the matrices when a transform changed and transforms the BVH bounds, O(1) whatever the triangle count.
+		//Positions and normals stay in object space for the bottom level BVH, HitTest_TriangleMesh transforms the ray instead
+		void UpdateTransforms();
+
+		/**
+		 * \brief Builds the object space BVH and stores the triangles in its leaf order
+		 * \param pThreadPool spreads the build over its threads when given
+		 * \param pStats optional, filled by BVH::Build
+		 */
+		void BuildBVH(ThreadPool* pThreadPool = nullptr, BVH::BuildStats* pStats = nullptr);
+
+		//World space normal of a triangle (leaf order index, as reported by the hit tests), transformed by the transposed inverse
+		Vector3 GetWorldNormal(size_t triangleIndex) const
+		{
+			return normalTransform.TransformVector(normals[triangleIndex]).Normalized();
+		}
+
+		const AABB& GetWorldBounds() const
+		{
+			return worldBounds;
 		}
+	};
+
+	//One more placement of a TriangleMesh: the geometry and its BVH stay in the mesh, an instance only adds a transform
+	//and optionally its own material, so memory grows with the unique meshes instead of with the placements
+	struct MeshInstance
+	{
+		static constexpr uint32_t noMaterialOverride{ UINT32_MAX };
+		static constexpr uint32_t noInstance{ UINT32_MAX }; //Marks a hit or placement of the mesh at its own transform
+
+		uint32_t meshIndex{};
+		uint32_t materialIndex{ noMaterialOverride }; //Of every face, noMaterialOverride keeps the materials of the mesh
+
+		Matrix worldTransform{};
+		//Cached by UpdateTransform, normals use its transpose
+		Matrix inverseTransform{};
+		AABB worldBounds{};
 
-		void CalculateNormals()
+		bool isTransformDirty{ true };
+
+		void SetTransform(const Matrix& transform)
 		{
-			assert(false && "No Implemented Yet!");
+			worldTransform = transform;
+			isTransformDirty = true;
 		}
 
-		void UpdateTransforms()
+		//mesh is the mesh the instance places, with its BVH built
+		void UpdateTransform(const TriangleMesh& mesh)
 		{
-			assert(false && "No Implemented Yet!");
-			//Calculate Final Transform 
-			//const auto finalTransform = ...
+			inverseTransform = Matrix::Inverse(worldTransform);
+			//The positions are not copied per instance
+			worldBounds = GetTransformedBounds(mesh.bvh, worldTransform);
+			isTransformDirty = false;
+		}
 
-			//Transform Positions (positions > transformedPositions)
-			//...
+		//World space normal of a triangle of the mesh (leaf order index), transformed by the transposed inverse
+		Vector3 GetWorldNormal(const TriangleMesh& mesh, size_t triangleIndex) const
+		{
+			const Vector3& normal{ mesh.normals[triangleIndex] };
+			return Vector3{
+				Vector3::Dot(inverseTransform.GetAxisX(), normal),
+				Vector3::Dot(inverseTransform.GetAxisY(), normal),
+				Vector3::Dot(inverseTransform.GetAxisZ(), normal) }.Normalized();
+		}
 
-			//Transform Normals (normals > transformedNormals)
-			//...
+		uint32_t GetMaterialIndex(const TriangleMesh& mesh, size_t triangleIndex) const
+		{
+			return materialIndex != noMaterialOverride ? materialIndex : mesh.GetMaterialIndex(triangleIndex);
 		}
 	};
 #pragma endregion
@@ -158,13 +386,12 @@ namespace dae
 	};
 #pragma endregion
 #pragma region MISC
-	struct Ray
+	enum class PrimitiveType : unsigned char
 	{
-		Vector3 origin{};
-		Vector3 direction{};
-
-		float min{ 0.0001f };
-		float max{ FLT_MAX };
+		Plane,
+		Sphere,
+		Triangle,
+		MeshTriangle
 	};
 
 	struct HitRecord
@@ -174,7 +401,17 @@ namespace dae
 		float t = FLT_MAX;
 
 		bool didHit{ false };
-		unsigned char materialIndex{ 0 };
+		uint32_t materialIndex{ 0 };
+	};
+
+	//All traversal keeps of the closest hit so far, the HitRecord is only resolved from it once traversal is done
+	struct HitCandidate
+	{
+		float t = FLT_MAX;
+		PrimitiveType type{};
+		uint32_t primitiveIndex{}; //Index within its own primitive list, MeshTriangle: triangle index within the mesh
+		uint32_t meshIndex{}; //MeshTriangle only
+		uint32_t instanceIndex{}; //MeshTriangle only, MeshInstance::noInstance when the mesh was hit at its own transform
 	};
 #pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "Image.h"
+
+#include <fstream>
+#include <vector>
+
+namespace dae
+{
+	namespace Image
+	{
+		namespace
+		{
+			void WriteLittleEndian(std::vector<uint8_t>& bytes, uint32_t value, int byteCount)
+			{
+				for (int i{}; i < byteCount; ++i)
+				{
+					bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+				}
+			}
+		}
+
+		bool Save(const std::string& path, const uint32_t* pPixels, int width, int height)
+		{
+			const size_t extensionStart{ path.find_last_of('.') };
+			if (extensionStart != std::string::npos && path.substr(extensionStart) == ".ppm")
+				return SavePPM(path, pPixels, width, height);
+
+			return SaveBMP(path, pPixels, width, height);
+		}
+
+		bool SaveBMP(const std::string& path, const uint32_t* pPixels, int width, int height)
+		{
+			//24 bit BGR, rows bottom to top and padded to 4 bytes
+			const uint32_t rowSize{ (static_cast<uint32_t>(width) * 3 + 3) & ~3u };
+			const uint32_t pixelDataSize{ rowSize * static_cast<uint32_t>(height) };
+			constexpr uint32_t headerSize{ 14 + 40 };
+
+			std::vector<uint8_t> bytes{};
+			bytes.reserve(headerSize + pixelDataSize);
+
+			//File header
+			bytes.push_back('B');
+			bytes.push_back('M');
+			WriteLittleEndian(bytes, headerSize + pixelDataSize, 4);
+			WriteLittleEndian(bytes, 0, 4);
+			WriteLittleEndian(bytes, headerSize, 4);
+
+			//Info header (BITMAPINFOHEADER)
+			WriteLittleEndian(bytes, 40, 4);
+			WriteLittleEndian(bytes, static_cast<uint32_t>(width), 4);
+			WriteLittleEndian(bytes, static_cast<uint32_t>(height), 4);
+			WriteLittleEndian(bytes, 1, 2);
+			WriteLittleEndian(bytes, 24, 2);
+			WriteLittleEndian(bytes, 0, 4);
+			WriteLittleEndian(bytes, pixelDataSize, 4);
+			WriteLittleEndian(bytes, 2835, 4); //72 DPI
+			WriteLittleEndian(bytes, 2835, 4);
+			WriteLittleEndian(bytes, 0, 4);
+			WriteLittleEndian(bytes, 0, 4);
+
+			for (int y{ height - 1 }; y >= 0; --y)
+			{
+				const uint32_t* pRow{ pPixels + static_cast<size_t>(y) * width };
+				for (int x{}; x < width; ++x)
+				{
+					WriteLittleEndian(bytes, pRow[x], 3);
+				}
+				for (uint32_t padding{ static_cast<uint32_t>(width) * 3 }; padding < rowSize; ++padding)
+				{
+					bytes.push_back(0);
+				}
+			}
+
+			std::ofstream file{ path, std::ios::binary };
+			file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			return file.good();
+		}
+
+		bool SavePPM(const std::string& path, const uint32_t* pPixels, int width, int height)
+		{
+			std::ofstream file{ path, std::ios::binary };
+			file << "P6\n" << width << ' ' << height << "\n255\n";
+
+			std::vector<uint8_t> bytes{};
+			bytes.reserve(static_cast<size_t>(width) * height * 3);
+			for (size_t i{}; i < static_cast<size_t>(width) * height; ++i)
+			{
+				bytes.push_back(static_cast<uint8_t>(pPixels[i] >> 16));
+				bytes.push_back(static_cast<uint8_t>(pPixels[i] >> 8));
+				bytes.push_back(static_cast<uint8_t>(pPixels[i]));
+			}
+
+			file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+			return file.good();
+		}
+	}
+}
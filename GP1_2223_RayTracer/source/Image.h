@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	namespace Image
+	{
+		/**
+		 * \brief Writes a 0x00RRGGBB framebuffer to disk, the format follows the extension (.ppm, anything else is written as .bmp)
+		 * \param path file to write
+		 * \param pPixels width * height pixels, rows top to bottom
+		 * \param width image width
+		 * \param height image height
+		 * \return true when the file was written
+		 */
+		bool Save(const std::string& path, const uint32_t* pPixels, int width, int height);
+
+		bool SaveBMP(const std::string& path, const uint32_t* pPixels, int width, int height);
+		bool SavePPM(const std::string& path, const uint32_t* pPixels, int width, int height);
+	}
+}
@@ -1,21 +1,32 @@
 #pragma once
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
 
 namespace dae
 {
-#pragma region Material BASE
-	class Material
+	//Materials are plain parameter blocks: no virtual calls, no heap allocation per material and safe to share
+	//between render threads. A MaterialTable stores them grouped by type and dispatches on a type tag
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+
+#pragma region Material SOLID COLOR
+	//SOLID COLOR
+	//===========
+	struct Material_SolidColor
+	{
+		static constexpr MaterialType type{ MaterialType::SolidColor };
 
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
+		ColorRGB color{ colors::White };
 
 		/**
 		 * \brief Function used to calculate the correct color for the specific material and its parameters
@@ -24,104 +35,207 @@ namespace dae
 		 * \param v view direction
 		 * \return color
 		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
-	};
-#pragma endregion
-
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
-	{
-	public:
-		Material_SolidColor(const ColorRGB& color): m_Color(color)
+		ColorRGB Shade(const HitRecord& /*hitRecord*/ = {}, const Vector3& /*l*/ = {}, const Vector3& /*v*/ = {}) const
 		{
+			return color;
 		}
-
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
-		{
-			return m_Color;
-		}
-
-	private:
-		ColorRGB m_Color{colors::White};
 	};
 #pragma endregion
 
 #pragma region Material LAMBERT
 	//LAMBERT
 	//=======
-	class Material_Lambert final : public Material
+	struct Material_Lambert
 	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
+		static constexpr MaterialType type{ MaterialType::Lambert };
+
+		ColorRGB diffuseColor{ colors::White };
+		float diffuseReflectance{ 1.f }; //kd
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& /*hitRecord*/ = {}, const Vector3& /*l*/ = {}, const Vector3& /*v*/ = {}) const
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			return BRDF::Lambert(diffuseReflectance, diffuseColor);
 		}
-
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{1.f}; //kd
 	};
 #pragma endregion
 
 #pragma region Material LAMBERT PHONG
 	//LAMBERT-PHONG
 	//=============
-	class Material_LambertPhong final : public Material
+	struct Material_LambertPhong
 	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		static constexpr MaterialType type{ MaterialType::LambertPhong };
+
+		ColorRGB diffuseColor{ colors::White };
+		float diffuseReflectance{ 0.5f }; //kd
+		float specularReflectance{ 0.5f }; //ks
+		float phongExponent{ 1.f }; //Phong Exponent
+
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
+			return BRDF::Lambert(diffuseReflectance, diffuseColor)
+			+ BRDF::Phong(specularReflectance, phongExponent, l, -v, hitRecord.normal);
 		}
+	};
+#pragma endregion
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+#pragma region Material COOK TORRENCE
+	//COOK TORRENCE
+	struct Material_CookTorrence
+	{
+		static constexpr MaterialType type{ MaterialType::CookTorrence };
+
+		ColorRGB albedo{ 0.955f, 0.637f, 0.538f }; //Copper
+		float metalness{ 1.0f };
+		float roughness{ 0.1f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+
+		//Derived from the parameters above by Compile, call it after editing them (the MaterialTable compiles on Add and Set)
+		ColorRGB f0{}; //Base reflectivity
+		ColorRGB oneMinusF0{};
+		ColorRGB diffuseColor{}; //albedo / PI, black for metals
+		float alpha2{}; //roughness^4 (UE4 remapping)
+		float alpha2OverPi{};
+		float alpha2MinusOne{};
+		float k{}; //Schlick GGX direct lighting term, (roughness^2 + 1)^2 / 8
+		float oneMinusK{};
+
+		void Compile()
 		{
-			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor)
-			+ BRDF::Phong(m_SpecularReflectance,m_PhongExponent,l,-v,hitRecord.normal);
+			const bool isMetal{ metalness >= 1.f };
+			f0 = isMetal ? albedo : ColorRGB{ 0.04f, 0.04f, 0.04f };
+			oneMinusF0 = ColorRGB{ 1.f - f0.r, 1.f - f0.g, 1.f - f0.b };
+			diffuseColor = isMetal ? ColorRGB{} : ColorRGB{ albedo.r / PI, albedo.g / PI, albedo.b / PI };
+
+			const float roughness2{ roughness * roughness };
+			alpha2 = roughness2 * roughness2;
+			alpha2OverPi = alpha2 / PI;
+			alpha2MinusOne = alpha2 - 1.f;
+			k = (roughness2 + 1.f) * (roughness2 + 1.f) / 8.f;
+			oneMinusK = 1.f - k;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{colors::White};
-		float m_DiffuseReflectance{0.5f}; //kd
-		float m_SpecularReflectance{0.5f}; //ks
-		float m_PhongExponent{1.f}; //Phong Exponent
+		//Same result as BRDF::FresnelFunction_Schlick, NormalDistribution_GGX and GeometryFunction_Smith combined
+		//(checked by the micro-benchmark) without powf: the compiled constants and a few multiplies.
+		//The n.v * n.l of the Smith term cancels against the specular denominator, so it is never divided by
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
+		{
+			const Vector3& n{ hitRecord.normal };
+			const Vector3 half{ (v + l).Normalized() };
+
+			//Fresnel: f0 + (1 - f0) * (1 - h.v)^5
+			const float x{ 1.f - Vector3::Dot(half, v) };
+			const float x2{ x * x };
+			const float schlick{ x2 * x2 * x };
+			const ColorRGB fresnel{ f0.r + oneMinusF0.r * schlick, f0.g + oneMinusF0.g * schlick, f0.b + oneMinusF0.b * schlick };
+
+			//GGX: alpha^2 / (PI * ((n.h)^2 * (alpha^2 - 1) + 1)^2)
+			const float nh{ Vector3::Dot(n, half) };
+			const float denominatorGGX{ nh * nh * alpha2MinusOne + 1.f };
+
+			//Smith / (4 * n.v * n.l) = 1 / (4 * (n.v * (1 - k) + k) * (n.l * (1 - k) + k))
+			const float geometryV{ Vector3::Dot(n, v) * oneMinusK + k };
+			const float geometryL{ Vector3::Dot(n, l) * oneMinusK + k };
+
+			const float specular{ alpha2OverPi / (4.f * denominatorGGX * denominatorGGX * geometryV * geometryL) };
+			return ColorRGB{
+				diffuseColor.r * (1.f - fresnel.r) + fresnel.r * specular,
+				diffuseColor.g * (1.f - fresnel.g) + fresnel.g * specular,
+				diffuseColor.b * (1.f - fresnel.b) + fresnel.b * specular };
+		}
 	};
 #pragma endregion
 
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
+#pragma region MaterialTable
+	//All materials of a scene. Every type has its own contiguous parameter array, a material index maps to a
+	//(type, slot) pair. Read only while rendering, so every thread can use it (or a copy of it) without locking
+	class MaterialTable final
 	{
 	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		//Adds a material, returns its material index
+		template<typename MaterialParameters>
+		uint32_t Add(const MaterialParameters& material)
+		{
+			assert(m_Entries.size() < UINT32_MAX && "MaterialTable is full, material indices are 32 bit");
+			std::vector<MaterialParameters>& parameters{ GetParameters<MaterialParameters>() };
+			m_Entries.push_back({ MaterialParameters::type, static_cast<uint32_t>(parameters.size()) });
+			parameters.push_back(Compile(material));
+			return static_cast<uint32_t>(m_Entries.size() - 1);
+		}
+
+		//Replaces the parameters of a material, the type of a material can not change
+		template<typename MaterialParameters>
+		void Set(uint32_t materialIndex, const MaterialParameters& material)
+		{
+			const Entry& entry{ m_Entries[materialIndex] };
+			assert(entry.type == MaterialParameters::type && "MaterialTable::Set can not change the material type");
+			GetParameters<MaterialParameters>()[entry.slot] = Compile(material);
+		}
+
+		size_t GetSize() const { return m_Entries.size(); }
+		MaterialType GetType(uint32_t materialIndex) const { return m_Entries[materialIndex].type; }
+
+		/**
+		 * \brief Calls visitor with the parameter block of a material, one switch on the type tag per call
+		 * \param materialIndex index returned by Add
+		 * \param visitor callable taking any of the Material_ parameter blocks (e.g. a generic lambda)
+		 * \return whatever visitor returns
+		 */
+		template<typename Visitor>
+		decltype(auto) Visit(uint32_t materialIndex, Visitor&& visitor) const
 		{
+			const Entry& entry{ m_Entries[materialIndex] };
+			switch (entry.type)
+			{
+			case MaterialType::Lambert:
+				return visitor(m_Lamberts[entry.slot]);
+			case MaterialType::LambertPhong:
+				return visitor(m_LambertPhongs[entry.slot]);
+			case MaterialType::CookTorrence:
+				return visitor(m_CookTorrences[entry.slot]);
+			default:
+				return visitor(m_SolidColors[entry.slot]);
+			}
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(uint32_t materialIndex, const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
 		{
-			ColorRGB F0 = m_Metalness >= 1.f ? m_Albedo : ColorRGB{ 0.04f, 0.04f, 0.04f };
-			Vector3 half = (v + l).Normalized();
-			ColorRGB fresnel = BRDF::FresnelFunction_Schlick(half, v, F0);
-			float distribution = BRDF::NormalDistribution_GGX(hitRecord.normal, half, m_Roughness);
-			float geometry = BRDF::GeometryFunction_Smith(hitRecord.normal, v, l, m_Roughness);
-			ColorRGB specular = (distribution * fresnel * geometry) * (1.f / (4.f * (Vector3::Dot(v, hitRecord.normal) *Vector3::Dot(l, hitRecord.normal))));
-
-			ColorRGB kd = m_Metalness >= 1.f ? ColorRGB{0.f,0.f,0.f} : ColorRGB{ 1.f,1.f,1.f } - fresnel;
-			auto diffuse = BRDF::Lambert(kd, m_Albedo);
-			return diffuse + specular;
+			return Visit(materialIndex, [&](const auto& material) { return material.Shade(hitRecord, l, v); });
 		}
 
 	private:
-		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
-		float m_Metalness{1.0f};
-		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		struct Entry
+		{
+			MaterialType type{};
+			uint32_t slot{}; //Index in the parameter array of the type
+		};
+
+		std::vector<Entry> m_Entries{};
+		std::vector<Material_SolidColor> m_SolidColors{};
+		std::vector<Material_Lambert> m_Lamberts{};
+		std::vector<Material_LambertPhong> m_LambertPhongs{};
+		std::vector<Material_CookTorrence> m_CookTorrences{};
+
+		//Materials with derived constants precompute them, so shading only reads them
+		template<typename MaterialParameters>
+		static MaterialParameters Compile(MaterialParameters material)
+		{
+			if constexpr (requires { material.Compile(); })
+				material.Compile();
+			return material;
+		}
+
+		template<typename MaterialParameters>
+		std::vector<MaterialParameters>& GetParameters()
+		{
+			if constexpr (MaterialParameters::type == MaterialType::Lambert)
+				return m_Lamberts;
+			else if constexpr (MaterialParameters::type == MaterialType::LambertPhong)
+				return m_LambertPhongs;
+			else if constexpr (MaterialParameters::type == MaterialType::CookTorrence)
+				return m_CookTorrences;
+			else
+				return m_SolidColors;
+		}
 	};
 #pragma endregion
 }
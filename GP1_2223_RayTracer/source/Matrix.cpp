@@ -82,6 +82,41 @@ namespace dae {
 		return out;
 	}
 
+	const Matrix& Matrix::Inverse()
+	{
+		//Affine inverse: invert the 3x3 part (adjugate / determinant), then move the translation back
+		const Vector3 xAxis{ data[0] };
+		const Vector3 yAxis{ data[1] };
+		const Vector3 zAxis{ data[2] };
+		const Vector3 translation{ data[3] };
+
+		const Vector3 yz{ Vector3::Cross(yAxis, zAxis) };
+		const Vector3 zx{ Vector3::Cross(zAxis, xAxis) };
+		const Vector3 xy{ Vector3::Cross(xAxis, yAxis) };
+		const float determinant{ Vector3::Dot(xAxis, yz) };
+		assert(determinant != 0.f && "Matrix is not invertible");
+		const float invDeterminant{ 1.f / determinant };
+
+		//Columns of the inverse are the cross products, so the rows are gathered component wise
+		data[0] = { yz.x * invDeterminant, zx.x * invDeterminant, xy.x * invDeterminant, 0.f };
+		data[1] = { yz.y * invDeterminant, zx.y * invDeterminant, xy.y * invDeterminant, 0.f };
+		data[2] = { yz.z * invDeterminant, zx.z * invDeterminant, xy.z * invDeterminant, 0.f };
+		data[3] = { 0.f, 0.f, 0.f, 1.f };
+
+		const Vector3 inverseTranslation{ -TransformVector(translation) };
+		data[3] = { inverseTranslation, 1.f };
+
+		return *this;
+	}
+
+	Matrix Matrix::Inverse(const Matrix& m)
+	{
+		Matrix out{ m };
+		out.Inverse();
+
+		return out;
+	}
+
 	Vector3 Matrix::GetAxisX() const
 	{
 		return data[0];
@@ -104,9 +139,7 @@ namespace dae {
 
 	Matrix Matrix::CreateTranslation(float x, float y, float z)
 	{
-		//todo W1
-		assert(false && "Not Implemented Yet");
-		return {};
+		return CreateTranslation({ x, y, z });
 	}
 
 	Matrix Matrix::CreateTranslation(const Vector3& t)
@@ -131,9 +164,7 @@ namespace dae {
 
 	Matrix Matrix::CreateRotation(const Vector3& r)
 	{
-		//todo W1
-		assert(false && "Not Implemented Yet");
-		return {};
+		return CreateRotationX(r[0]) * CreateRotationY(r[1]) * CreateRotationZ(r[2]);
 	}
 
 	Matrix Matrix::CreateRotation(float pitch, float yaw, float roll)
@@ -143,9 +174,7 @@ namespace dae {
 
 	Matrix Matrix::CreateScale(float sx, float sy, float sz)
 	{
-		//todo W1
-		assert(false && "Not Implemented Yet");
-		return {};
+		return { Vector3{ sx, 0.f, 0.f }, Vector3{ 0.f, sy, 0.f }, Vector3{ 0.f, 0.f, sz }, Vector3::Zero };
 	}
 
 	Matrix Matrix::CreateScale(const Vector3& s)
@@ -0,0 +1,345 @@
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ObjLoader.h"
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		namespace
+		{
+			//Bump on every change of the header or of a section layout, older files are then rebuilt
+			constexpr uint32_t g_Version{ 2 };
+			constexpr char g_Magic[8]{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+			constexpr size_t g_SectionAlignment{ 64 };
+
+			static_assert(std::is_trivially_copyable_v<Vector3> && std::is_trivially_copyable_v<BVHNode> && std::is_trivially_copyable_v<PrecomputedTriangle>,
+				"Mesh cache sections are copied as raw bytes");
+
+			struct Section
+			{
+				uint64_t offset{}; //From the start of the file, a multiple of g_SectionAlignment
+				uint64_t count{}; //Elements, not bytes
+			};
+
+			struct Header
+			{
+				char magic[8]{};
+				uint32_t version{};
+				uint32_t headerSize{};
+				uint64_t contentHash{};
+
+				//Element sizes of the writer, a build with another layout (compiler, padding) rejects the file
+				uint32_t vector3Size{};
+				uint32_t nodeSize{};
+				uint32_t triangleSize{};
+				uint32_t padding{};
+
+				Section positions{};
+				Section normals{};
+				Section indices{};
+				Section nodes{};
+				Section primitiveIndices{};
+				Section precomputedTriangles{};
+				Section sourceFaceIndices{};
+			};
+
+			size_t AlignUp(size_t value)
+			{
+				return (value + g_SectionAlignment - 1) & ~(g_SectionAlignment - 1);
+			}
+
+			//Points a section at the end of the file so far and moves the end behind it
+			template<typename Element>
+			Section Reserve(size_t& fileSize, size_t count)
+			{
+				const Section section{ AlignUp(fileSize), count };
+				fileSize = section.offset + count * sizeof(Element);
+				return section;
+			}
+
+			template<typename Element>
+			void Write(std::vector<char>& bytes, const Section& section, const Element* pElements)
+			{
+				if (section.count > 0)
+					std::memcpy(bytes.data() + section.offset, pElements, section.count * sizeof(Element));
+			}
+
+			template<typename Element>
+			bool IsInside(const Section& section, size_t fileSize)
+			{
+				return section.offset % g_SectionAlignment == 0 && section.offset <= fileSize
+					&& section.count <= (fileSize - section.offset) / sizeof(Element);
+			}
+
+			template<typename Element>
+			const Element* GetElements(const MappedFile& file, const Section& section)
+			{
+				return reinterpret_cast<const Element*>(file.GetData() + section.offset);
+			}
+
+			//Every stored index points inside its section, so a damaged file can not send a ray out of bounds
+			bool AreIndicesValid(const MappedFile& file, const Header& header)
+			{
+				const int* pIndices{ GetElements<int>(file, header.indices) };
+				for (size_t i{}; i < header.indices.count; ++i)
+				{
+					if (pIndices[i] < 0 || static_cast<uint64_t>(pIndices[i]) >= header.positions.count)
+						return false;
+				}
+
+				const uint32_t* pPrimitiveIndices{ GetElements<uint32_t>(file, header.primitiveIndices) };
+				for (size_t i{}; i < header.primitiveIndices.count; ++i)
+				{
+					if (pPrimitiveIndices[i] >= header.precomputedTriangles.count)
+						return false;
+				}
+
+				const uint32_t* pSourceFaceIndices{ GetElements<uint32_t>(file, header.sourceFaceIndices) };
+				for (size_t i{}; i < header.sourceFaceIndices.count; ++i)
+				{
+					if (pSourceFaceIndices[i] >= header.normals.count)
+						return false;
+				}
+
+				const BVHNode* pNodes{ GetElements<BVHNode>(file, header.nodes) };
+				for (size_t i{}; i < header.nodes.count; ++i)
+				{
+					const BVHNode& node{ pNodes[i] };
+					const uint64_t end{ static_cast<uint64_t>(node.leftFirst) + (node.IsLeaf() ? node.primitiveCount : 2) };
+					if (end > (node.IsLeaf() ? header.primitiveIndices.count : header.nodes.count) || (!node.IsLeaf() && node.leftFirst <= i))
+						return false;
+				}
+
+				//BVH::Traverse walks with a fixed size stack, so a tree deeper than a build makes is rejected.
+				//Children always come after their parent, a node reached twice means the file is not a tree
+				if (header.nodes.count == 0)
+					return true;
+
+				std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0u, 0u } };
+				size_t visitedCount{};
+				while (!stack.empty())
+				{
+					const auto [nodeIndex, depth] = stack.back();
+					stack.pop_back();
+					if (depth > BVH::maxDepth || ++visitedCount > header.nodes.count)
+						return false;
+
+					const BVHNode& node{ pNodes[nodeIndex] };
+					if (!node.IsLeaf())
+					{
+						stack.emplace_back(node.leftFirst, depth + 1);
+						stack.emplace_back(node.leftFirst + 1, depth + 1);
+					}
+				}
+				return true;
+			}
+		}
+
+		uint64_t HashContent(const char* pData, size_t size)
+		{
+			//FNV-1a over 8 byte words instead of bytes, the length is mixed in at the end
+			constexpr uint64_t prime{ 0x100000001b3ull };
+			uint64_t hash{ 0xcbf29ce484222325ull };
+
+			size_t i{};
+			for (; i + 8 <= size; i += 8)
+			{
+				uint64_t word{};
+				std::memcpy(&word, pData + i, 8);
+				hash = (hash ^ word) * prime;
+			}
+			for (; i < size; ++i)
+			{
+				hash = (hash ^ static_cast<uint8_t>(pData[i])) * prime;
+			}
+
+			hash = (hash ^ size) * prime;
+			return hash ^ (hash >> 32);
+		}
+
+		std::string GetCachePath(const std::string& cacheDirectory, uint64_t contentHash)
+		{
+			char name[32]{};
+			std::snprintf(name, sizeof(name), "%016llx.meshcache", static_cast<unsigned long long>(contentHash));
+			return (std::filesystem::path{ cacheDirectory } / name).string();
+		}
+
+		bool Save(const std::string& path, const TriangleMesh& mesh, uint64_t contentHash)
+		{
+			if (mesh.isBVHDirty)
+				return false;
+
+			Header header{};
+			std::memcpy(header.magic, g_Magic, sizeof(g_Magic));
+			header.version = g_Version;
+			header.headerSize = sizeof(Header);
+			header.contentHash = contentHash;
+			header.vector3Size = sizeof(Vector3);
+			header.nodeSize = sizeof(BVHNode);
+			header.triangleSize = sizeof(PrecomputedTriangle);
+
+			size_t fileSize{ sizeof(Header) };
+			header.positions = Reserve<Vector3>(fileSize, mesh.positions.size());
+			header.normals = Reserve<Vector3>(fileSize, mesh.normals.size());
+			header.indices = Reserve<int>(fileSize, mesh.indices.size());
+			header.nodes = Reserve<BVHNode>(fileSize, mesh.bvh.GetNodes().size());
+			header.primitiveIndices = Reserve<uint32_t>(fileSize, mesh.bvh.GetPrimitiveIndices().size());
+			header.precomputedTriangles = Reserve<PrecomputedTriangle>(fileSize, mesh.precomputedTriangles.size());
+			header.sourceFaceIndices = Reserve<uint32_t>(fileSize, mesh.sourceFaceIndices.size());
+
+			std::vector<char> bytes(fileSize);
+			std::memcpy(bytes.data(), &header, sizeof(Header));
+			Write(bytes, header.positions, mesh.positions.data());
+			Write(bytes, header.normals, mesh.normals.data());
+			Write(bytes, header.indices, mesh.indices.data());
+			Write(bytes, header.nodes, mesh.bvh.GetNodes().data());
+			Write(bytes, header.primitiveIndices, mesh.bvh.GetPrimitiveIndices().data());
+			Write(bytes, header.precomputedTriangles, mesh.precomputedTriangles.data());
+			Write(bytes, header.sourceFaceIndices, mesh.sourceFaceIndices.data());
+
+			const std::string temporaryPath{ path + ".tmp" };
+			{
+				std::ofstream file{ temporaryPath, std::ios::binary | std::ios::trunc };
+				if (!file.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+					return false;
+			}
+
+			std::error_code error{};
+			std::filesystem::rename(temporaryPath, path, error);
+			if (error)
+			{
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+			return true;
+		}
+
+		bool Load(const std::string& path, TriangleMesh& mesh, uint64_t contentHash)
+		{
+			MappedFile file{};
+			if (!file.Open(path) || file.GetSize() < sizeof(Header))
+				return false;
+
+			Header header{};
+			std::memcpy(&header, file.GetData(), sizeof(Header));
+			const size_t fileSize{ file.GetSize() };
+			const bool isValid{ std::memcmp(header.magic, g_Magic, sizeof(g_Magic)) == 0
+				&& header.version == g_Version
+				&& header.headerSize == sizeof(Header)
+				&& header.contentHash == contentHash
+				&& header.vector3Size == sizeof(Vector3)
+				&& header.nodeSize == sizeof(BVHNode)
+				&& header.triangleSize == sizeof(PrecomputedTriangle)
+				&& IsInside<Vector3>(header.positions, fileSize)
+				&& IsInside<Vector3>(header.normals, fileSize)
+				&& IsInside<int>(header.indices, fileSize)
+				&& IsInside<BVHNode>(header.nodes, fileSize)
+				&& IsInside<uint32_t>(header.primitiveIndices, fileSize)
+				&& IsInside<PrecomputedTriangle>(header.precomputedTriangles, fileSize)
+				&& IsInside<uint32_t>(header.sourceFaceIndices, fileSize)
+				&& header.indices.count == 3 * header.normals.count
+				&& header.precomputedTriangles.count == header.normals.count
+				&& header.sourceFaceIndices.count == header.normals.count };
+			if (!isValid || !AreIndicesValid(file, header))
+				return false;
+
+			const Vector3* pPositions{ GetElements<Vector3>(file, header.positions) };
+			const Vector3* pNormals{ GetElements<Vector3>(file, header.normals) };
+			const int* pIndices{ GetElements<int>(file, header.indices) };
+			const PrecomputedTriangle* pTriangles{ GetElements<PrecomputedTriangle>(file, header.precomputedTriangles) };
+			const uint32_t* pSourceFaceIndices{ GetElements<uint32_t>(file, header.sourceFaceIndices) };
+			mesh.positions.assign(pPositions, pPositions + header.positions.count);
+			mesh.normals.assign(pNormals, pNormals + header.normals.count);
+			mesh.indices.assign(pIndices, pIndices + header.indices.count);
+			mesh.precomputedTriangles.assign(pTriangles, pTriangles + header.precomputedTriangles.count);
+			mesh.sourceFaceIndices.assign(pSourceFaceIndices, pSourceFaceIndices + header.sourceFaceIndices.count);
+			mesh.bvh.Assign(GetElements<BVHNode>(file, header.nodes), header.nodes.count,
+				GetElements<uint32_t>(file, header.primitiveIndices), header.primitiveIndices.count);
+			mesh.faceMaterialIndices.clear();
+
+			//The cull mode belongs to the mesh, not to the file
+			for (PrecomputedTriangle& triangle : mesh.precomputedTriangles)
+			{
+				triangle.cullMode = mesh.cullMode;
+			}
+
+			mesh.isBVHDirty = false;
+			mesh.isTransformDirty = true;
+			return true;
+		}
+
+		bool LoadOBJ(const std::string& objPath, TriangleMesh& mesh, const std::string& cacheDirectory, ThreadPool* pThreadPool, LoadStats* pStats)
+		{
+			using Clock = std::chrono::steady_clock;
+			const auto start{ Clock::now() };
+
+			uint64_t contentHash{};
+			size_t sourceByteCount{};
+			{
+				MappedFile source{};
+				if (!source.Open(objPath))
+				{
+					if (pStats)
+						pStats->error = objPath + ": can not be opened";
+					return false;
+				}
+
+				sourceByteCount = source.GetSize();
+				contentHash = HashContent(source.GetData(), source.GetSize());
+			}
+			const std::chrono::duration<double, std::milli> hashTime{ Clock::now() - start };
+
+			const std::string directory{ cacheDirectory.empty() ? std::filesystem::path{ objPath }.parent_path().string() : cacheDirectory };
+			const std::string cachePath{ GetCachePath(directory, contentHash) };
+
+			const bool isCacheHit{ Load(cachePath, mesh, contentHash) };
+			BVH::BuildStats bvhStats{};
+			if (!isCacheHit)
+			{
+				//Parsed aside, a malformed file leaves the mesh as it was
+				std::vector<Vector3> positions{};
+				std::vector<Vector3> normals{};
+				std::vector<int> indices{};
+				ObjLoader::LoadStats objStats{};
+				if (!ObjLoader::Load(objPath, positions, normals, indices, pThreadPool, &objStats))
+				{
+					if (pStats)
+						pStats->error = objStats.error;
+					return false;
+				}
+
+				mesh.positions = std::move(positions);
+				mesh.normals = std::move(normals);
+				mesh.indices = std::move(indices);
+				mesh.faceMaterialIndices.clear();
+				mesh.sourceFaceIndices.clear();
+				mesh.BuildBVH(pThreadPool, &bvhStats);
+				mesh.isTransformDirty = true;
+				Save(cachePath, mesh, contentHash);
+			}
+
+			if (pStats)
+			{
+				pStats->isCacheHit = isCacheHit;
+				pStats->sourceByteCount = sourceByteCount;
+				pStats->triangleCount = mesh.indices.size() / 3;
+				pStats->hashMilliseconds = hashTime.count();
+				pStats->bvhMilliseconds = bvhStats.milliseconds;
+				pStats->milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				pStats->cachePath = cachePath;
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Binary copy of a loaded and BVH-built TriangleMesh. One file holds a header and 64 byte aligned sections
+	//(positions, face normals, indices, BVH nodes, BVH primitive indices, precomputed triangles, source face indices), all in leaf order.
+	//A cache file is named after the content hash of its source file, so any edit of the source misses the cache
+	namespace MeshCache
+	{
+		//What LoadOBJ did and how long it took
+		struct LoadStats
+		{
+			bool isCacheHit{ false };
+			size_t sourceByteCount{};
+			size_t triangleCount{};
+			double hashMilliseconds{}; //Hashing the source file, part of milliseconds
+			double bvhMilliseconds{}; //Building the BVH on a cache miss, part of milliseconds
+			double milliseconds{};
+			std::string cachePath{};
+			//Why LoadOBJ returned false, empty when it did not
+			std::string error{};
+		};
+
+		//64 bit hash of a whole file content, several bytes per cycle
+		uint64_t HashContent(const char* pData, size_t size);
+
+		//cacheDirectory/<16 hex digits of contentHash>.meshcache
+		std::string GetCachePath(const std::string& cacheDirectory, uint64_t contentHash);
+
+		/**
+		 * \brief Writes a mesh with a built BVH (isBVHDirty false), through a temporary file so a reader never sees half a file
+		 * \param path cache file to write
+		 * \param mesh mesh to store, materials and transforms are not stored
+		 * \param contentHash hash of the source the mesh was loaded from
+		 * \return true when the file was written
+		 */
+		bool Save(const std::string& path, const TriangleMesh& mesh, uint64_t contentHash);
+
+		/**
+		 * \brief Memory maps a cache file and copies its sections into the mesh, nothing is parsed or rebuilt.
+		 * The cull mode of the mesh is kept
+		 * \param path cache file to read
+		 * \param mesh receives geometry and BVH, only written when the file is valid
+		 * \param contentHash expected hash of the source, a file written for other content is rejected
+		 * \return false when the file is missing, of another format version or layout, truncated, for other content
+		 * or when its hierarchy is not a tree of at most BVH::maxDepth levels
+		 */
+		bool Load(const std::string& path, TriangleMesh& mesh, uint64_t contentHash);
+
+		/**
+		 * \brief Loads an OBJ file through the cache: hashes the file, loads the matching cache file when there is one,
+		 * otherwise parses the OBJ (ObjLoader), builds the BVH and writes the cache file for the next run
+		 * \param objPath OBJ file
+		 * \param mesh receives geometry and BVH, only written when the load succeeds. Set the cull mode before calling
+		 * \param cacheDirectory where cache files go, empty uses the directory of the OBJ file
+		 * \param pThreadPool parses the OBJ and builds the BVH in parallel when given, nullptr does both on the calling thread
+		 * \param pStats optional, filled with what happened and how long it took, or with the error when the load fails
+		 * \return false when the OBJ file can not be loaded (a cache that can not be written is not an error)
+		 */
+		bool LoadOBJ(const std::string& objPath, TriangleMesh& mesh, const std::string& cacheDirectory = {},
+			ThreadPool* pThreadPool = nullptr, LoadStats* pStats = nullptr);
+	}
+}
@@ -0,0 +1,395 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include "BRDFs.h"
+#include "Material.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		namespace
+		{
+			//Power of two, so a kernel picks its input with a mask. Small enough to stay in cache, kernels are timed without memory stalls
+			constexpr size_t g_InputCount{ 1024 };
+			constexpr size_t g_BatchSphereCount{ 16 };
+
+			//Every kernel result is summed into this, so the compiler can not drop the calls
+			volatile float g_Sink{};
+
+			//Largest accepted difference between a compiled shading kernel and its BRDF:: reference,
+			//relative to the reference (absolute below 1, where the reference itself is close to 0)
+			constexpr float g_MaxShadingError{ 1e-4f };
+			constexpr size_t g_ValidationSampleCount{ 1'000'000 };
+
+			//Random inputs shared by all kernels, the same seed gives the same inputs every run
+			struct Inputs
+			{
+				std::vector<Ray> rays{};
+				std::vector<Vector3> invDirections{};
+				std::vector<Sphere> spheres{};
+				std::vector<Plane> planes{};
+				std::vector<Triangle> triangles{};
+				std::vector<PrecomputedTriangle> precomputedTriangles{};
+				std::vector<AABB> boxes{};
+				SphereSoA sphereSoA{};
+
+				//Shading: normal, view and light direction all in the same hemisphere
+				std::vector<Vector3> normals{};
+				std::vector<Vector3> viewDirections{};
+				std::vector<Vector3> lightDirections{};
+				std::vector<Vector3> halfVectors{};
+				std::vector<float> roughness{};
+				std::vector<ColorRGB> colors{};
+				std::vector<Material_CookTorrence> cookTorrences{}; //Compiled, alternating dielectric and metal
+
+				std::vector<Matrix> matrices{};
+				std::vector<Vector3> vectors{};
+			};
+
+			Inputs CreateInputs()
+			{
+				std::mt19937 generator{ 42 };
+				std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+				std::uniform_real_distribution<float> positive{ 0.f, 1.f };
+				const auto randomVector = [&](float scale) { return Vector3{ unit(generator), unit(generator), unit(generator) } * scale; };
+				const auto randomDirection = [&]()
+					{
+						Vector3 direction{};
+						while (direction.SqrMagnitude() < .01f)
+						{
+							direction = randomVector(1.f);
+						}
+						return direction.Normalized();
+					};
+
+				Inputs inputs{};
+				for (size_t i{}; i < g_InputCount; ++i)
+				{
+					//Rays from in front of the unit box towards points inside it, roughly half of them hit
+					Ray ray{};
+					ray.origin = randomVector(5.f) + Vector3{ 0.f, 0.f, -10.f };
+					ray.direction = (randomVector(2.f) - ray.origin).Normalized();
+					inputs.rays.push_back(ray);
+					inputs.invDirections.emplace_back(1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z);
+
+					Sphere sphere{};
+					sphere.origin = randomVector(2.f);
+					sphere.radius = .2f + .8f * positive(generator);
+					inputs.spheres.push_back(sphere);
+					inputs.sphereSoA.Add(sphere);
+
+					Plane plane{};
+					plane.origin = randomVector(2.f);
+					plane.normal = randomDirection();
+					inputs.planes.push_back(plane);
+
+					const Vector3 center{ randomVector(2.f) };
+					Triangle triangle{ center + randomVector(1.f), center + randomVector(1.f), center + randomVector(1.f) };
+					triangle.cullMode = TriangleCullMode::NoCulling;
+					inputs.triangles.push_back(triangle);
+					inputs.precomputedTriangles.emplace_back(triangle, static_cast<uint32_t>(i));
+
+					AABB box{};
+					box.Grow(center - Vector3{ .5f, .5f, .5f });
+					box.Grow(center + Vector3{ .5f, .5f, .5f });
+					inputs.boxes.push_back(box);
+
+					const Vector3 normal{ randomDirection() };
+					Vector3 view{ randomDirection() };
+					Vector3 light{ randomDirection() };
+					if (Vector3::Dot(normal, view) < 0.f)
+						view = -view;
+					if (Vector3::Dot(normal, light) < 0.f)
+						light = -light;
+					inputs.normals.push_back(normal);
+					inputs.viewDirections.push_back(view);
+					inputs.lightDirections.push_back(light);
+					inputs.halfVectors.push_back((view + light).Normalized());
+					inputs.roughness.push_back(.05f + .95f * positive(generator));
+					inputs.colors.push_back({ positive(generator), positive(generator), positive(generator) });
+
+					Material_CookTorrence cookTorrence{ inputs.colors.back(), static_cast<float>(i & 1), inputs.roughness.back() };
+					cookTorrence.Compile();
+					inputs.cookTorrences.push_back(cookTorrence);
+
+					inputs.matrices.push_back(Matrix::CreateScale(Vector3{ 1.f, 1.f, 1.f } + randomVector(.5f))
+						* Matrix::CreateRotation(randomVector(PI)) * Matrix::CreateTranslation(randomVector(10.f)));
+					inputs.vectors.push_back(randomVector(10.f));
+				}
+				return inputs;
+			}
+
+			float Sum(const Vector3& v) { return v.x + v.y + v.z; }
+			float Sum(const ColorRGB& c) { return c.r + c.g + c.b; }
+
+			//Cook-Torrance composed from the BRDF:: terms with the uncompiled parameters, what the compiled kernel has to match
+			ColorRGB ShadeCookTorrenceReference(const Material_CookTorrence& material, const Vector3& n, const Vector3& l, const Vector3& v)
+			{
+				const ColorRGB f0{ material.metalness >= 1.f ? material.albedo : ColorRGB{ 0.04f, 0.04f, 0.04f } };
+				const Vector3 half{ (v + l).Normalized() };
+				const ColorRGB fresnel{ BRDF::FresnelFunction_Schlick(half, v, f0) };
+				const float distribution{ BRDF::NormalDistribution_GGX(n, half, material.roughness) };
+				const float geometry{ BRDF::GeometryFunction_Smith(n, v, l, material.roughness) };
+				const float specular{ distribution * geometry / (4.f * Vector3::Dot(v, n) * Vector3::Dot(l, n)) };
+
+				const ColorRGB kd{ material.metalness >= 1.f ? ColorRGB{} : ColorRGB{ 1.f - fresnel.r, 1.f - fresnel.g, 1.f - fresnel.b } };
+				const ColorRGB diffuse{ BRDF::Lambert(kd, material.albedo) };
+				return ColorRGB{ diffuse.r + fresnel.r * specular, diffuse.g + fresnel.g * specular, diffuse.b + fresnel.b * specular };
+			}
+
+			/**
+			 * \brief Compares Material_CookTorrence::Shade against ShadeCookTorrenceReference on random materials and directions
+			 * \param output stream the largest error is written to
+			 * \return whether every sample is within g_MaxShadingError
+			 */
+			bool ValidateCookTorrence(std::ostream& output)
+			{
+				std::mt19937 generator{ 7 };
+				std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+				std::uniform_real_distribution<float> positive{ 0.f, 1.f };
+				const auto randomHemisphere = [&](const Vector3& n)
+					{
+						//Not closer than about 1 degree to the horizon, where n.v * n.l makes the reference itself unstable
+						Vector3 direction{};
+						while (direction.SqrMagnitude() < .01f || Vector3::Dot(direction.Normalized(), n) < .02f)
+						{
+							direction = { unit(generator), unit(generator), unit(generator) };
+						}
+						return direction.Normalized();
+					};
+
+				float maxError{};
+				for (size_t i{}; i < g_ValidationSampleCount; ++i)
+				{
+					Material_CookTorrence material{ { positive(generator), positive(generator), positive(generator) },
+						positive(generator) < .5f ? 0.f : 1.f, .05f + .95f * positive(generator) };
+					material.Compile();
+
+					HitRecord hitRecord{};
+					hitRecord.normal = Vector3{ unit(generator), unit(generator), unit(generator) }.Normalized();
+					const Vector3 l{ randomHemisphere(hitRecord.normal) };
+					const Vector3 v{ randomHemisphere(hitRecord.normal) };
+
+					const ColorRGB compiled{ material.Shade(hitRecord, l, v) };
+					const ColorRGB reference{ ShadeCookTorrenceReference(material, hitRecord.normal, l, v) };
+					const float channels[][2]{ { compiled.r, reference.r }, { compiled.g, reference.g }, { compiled.b, reference.b } };
+					for (const auto& channel : channels)
+					{
+						maxError = std::max(maxError, std::abs(channel[0] - channel[1]) / std::max(std::abs(channel[1]), 1.f));
+					}
+				}
+
+				const bool isValid{ maxError <= g_MaxShadingError };
+				output << std::scientific << std::setprecision(2) << "Material_CookTorrence::Shade vs BRDF:: reference: max relative error "
+					<< maxError << " over " << g_ValidationSampleCount << " samples, bound " << g_MaxShadingError
+					<< (isValid ? " (ok)" : " (FAILED)") << '\n' << std::defaultfloat;
+				return isValid;
+			}
+
+			/**
+			 * \brief Times kernel(inputIndex) in repetitions of options.callCount calls and writes one table row
+			 * \param kernel float(size_t inputIndex), the result only feeds g_Sink
+			 */
+			template<typename Kernel>
+			void Measure(const MicroOptions& options, std::ostream& output, const char* name, Kernel&& kernel)
+			{
+				using Clock = std::chrono::steady_clock;
+
+				if (std::string{ name }.find(options.kernelFilter) == std::string::npos)
+					return;
+
+				std::vector<double> samples{};
+				samples.reserve(options.repetitionCount);
+
+				float sink{};
+				for (int repetition{ -options.warmUpRepetitionCount }; repetition < options.repetitionCount; ++repetition)
+				{
+					const auto start{ Clock::now() };
+					for (size_t i{}; i < static_cast<size_t>(options.callCount); ++i)
+					{
+						sink += kernel(i & (g_InputCount - 1));
+					}
+					const std::chrono::duration<double, std::nano> time{ Clock::now() - start };
+
+					if (repetition >= 0)
+						samples.push_back(time.count() / options.callCount);
+				}
+				g_Sink = sink;
+
+				double mean{};
+				for (const double sample : samples)
+				{
+					mean += sample;
+				}
+				mean /= samples.size();
+
+				double variance{};
+				for (const double sample : samples)
+				{
+					variance += (sample - mean) * (sample - mean);
+				}
+				variance /= std::max<size_t>(samples.size() - 1, 1);
+
+				std::sort(samples.begin(), samples.end());
+
+				output << std::fixed << std::setprecision(2)
+					<< std::left << std::setw(36) << name << std::right
+					<< std::setw(12) << mean
+					<< std::setw(12) << std::sqrt(variance)
+					<< std::setw(12) << samples.front()
+					<< std::setw(12) << samples[samples.size() / 2]
+					<< std::setw(14) << 1e3 / mean << '\n';
+			}
+		}
+
+		bool RunMicroBenchmarks(const MicroOptions& options, std::ostream& output)
+		{
+			const bool isValid{ ValidateCookTorrence(output) };
+			const Inputs inputs{ CreateInputs() };
+
+			output << std::left << std::setw(36) << "kernel" << std::right
+				<< std::setw(12) << "ns/call"
+				<< std::setw(12) << "stddev"
+				<< std::setw(12) << "min"
+				<< std::setw(12) << "median"
+				<< std::setw(14) << "Mcalls/s" << '\n';
+
+			//Loop, input load and sink only: the floor every other row should be read against
+			Measure(options, output, "Baseline (empty kernel)", [&](size_t i)
+				{
+					return inputs.roughness[i];
+				});
+
+#pragma region GeometryUtils
+			Measure(options, output, "HitTest_Sphere (HitRecord)", [&](size_t i)
+				{
+					HitRecord hitRecord{};
+					GeometryUtils::HitTest_Sphere(inputs.spheres[i], inputs.rays[i], hitRecord);
+					return hitRecord.t;
+				});
+			Measure(options, output, "HitTest_Sphere (t)", [&](size_t i)
+				{
+					float t{};
+					return GeometryUtils::HitTest_Sphere(inputs.spheres[i], inputs.rays[i], t) ? t : 0.f;
+				});
+			Measure(options, output, "HitTest_Sphere (any hit)", [&](size_t i)
+				{
+					return static_cast<float>(GeometryUtils::HitTest_Sphere(inputs.spheres[i], inputs.rays[i]));
+				});
+			Measure(options, output, "HitTest_Spheres (16 per call)", [&](size_t i)
+				{
+					float tMax{ FLT_MAX };
+					const size_t first{ i & (g_InputCount - g_BatchSphereCount) };
+					return static_cast<float>(GeometryUtils::HitTest_Spheres(inputs.sphereSoA, first, g_BatchSphereCount, inputs.rays[i], tMax));
+				});
+			Measure(options, output, "HitTest_Plane (HitRecord)", [&](size_t i)
+				{
+					HitRecord hitRecord{};
+					GeometryUtils::HitTest_Plane(inputs.planes[i], inputs.rays[i], hitRecord);
+					return hitRecord.t;
+				});
+			Measure(options, output, "HitTest_Plane (t)", [&](size_t i)
+				{
+					float t{};
+					return GeometryUtils::HitTest_Plane(inputs.planes[i], inputs.rays[i], t) ? t : 0.f;
+				});
+			Measure(options, output, "HitTest_Triangle (HitRecord)", [&](size_t i)
+				{
+					HitRecord hitRecord{};
+					GeometryUtils::HitTest_Triangle(inputs.triangles[i], inputs.rays[i], hitRecord);
+					return hitRecord.t;
+				});
+			Measure(options, output, "HitTest_Triangle (precomputed)", [&](size_t i)
+				{
+					float t{};
+					return GeometryUtils::HitTest_Triangle(inputs.precomputedTriangles[i], inputs.rays[i], t) ? t : 0.f;
+				});
+			Measure(options, output, "HitTest_AABB", [&](size_t i)
+				{
+					const float tNear{ HitTest_AABB(inputs.boxes[i], inputs.rays[i].origin, inputs.invDirections[i], inputs.rays[i].min, inputs.rays[i].max) };
+					return tNear == FLT_MAX ? 0.f : tNear;
+				});
+#pragma endregion
+
+#pragma region BRDF
+			Measure(options, output, "BRDF::Lambert", [&](size_t i)
+				{
+					return Sum(BRDF::Lambert(inputs.roughness[i], inputs.colors[i]));
+				});
+			Measure(options, output, "BRDF::Phong", [&](size_t i)
+				{
+					return Sum(BRDF::Phong(.5f, 40.f * inputs.roughness[i], inputs.lightDirections[i], inputs.viewDirections[i], inputs.normals[i]));
+				});
+			Measure(options, output, "BRDF::FresnelFunction_Schlick", [&](size_t i)
+				{
+					return Sum(BRDF::FresnelFunction_Schlick(inputs.halfVectors[i], inputs.viewDirections[i], inputs.colors[i]));
+				});
+			Measure(options, output, "BRDF::NormalDistribution_GGX", [&](size_t i)
+				{
+					return BRDF::NormalDistribution_GGX(inputs.normals[i], inputs.halfVectors[i], inputs.roughness[i]);
+				});
+			Measure(options, output, "BRDF::GeometryFunction_SchlickGGX", [&](size_t i)
+				{
+					return BRDF::GeometryFunction_SchlickGGX(inputs.normals[i], inputs.viewDirections[i], inputs.roughness[i]);
+				});
+			Measure(options, output, "BRDF::GeometryFunction_Smith", [&](size_t i)
+				{
+					return BRDF::GeometryFunction_Smith(inputs.normals[i], inputs.viewDirections[i], inputs.lightDirections[i], inputs.roughness[i]);
+				});
+			Measure(options, output, "CookTorrence (BRDF:: reference)", [&](size_t i)
+				{
+					return Sum(ShadeCookTorrenceReference(inputs.cookTorrences[i], inputs.normals[i], inputs.lightDirections[i], inputs.viewDirections[i]));
+				});
+			Measure(options, output, "Material_CookTorrence::Shade", [&](size_t i)
+				{
+					HitRecord hitRecord{};
+					hitRecord.normal = inputs.normals[i];
+					return Sum(inputs.cookTorrences[i].Shade(hitRecord, inputs.lightDirections[i], inputs.viewDirections[i]));
+				});
+#pragma endregion
+
+#pragma region Matrix / Vector3
+			Measure(options, output, "Matrix::operator*", [&](size_t i)
+				{
+					const Matrix product{ inputs.matrices[i] * inputs.matrices[(i + 1) & (g_InputCount - 1)] };
+					return product[0][0] + product[3][3];
+				});
+			Measure(options, output, "Matrix::Inverse", [&](size_t i)
+				{
+					const Matrix inverse{ Matrix::Inverse(inputs.matrices[i]) };
+					return inverse[0][0] + inverse[3][3];
+				});
+			Measure(options, output, "Matrix::TransformPoint", [&](size_t i)
+				{
+					return Sum(inputs.matrices[i].TransformPoint(inputs.vectors[i]));
+				});
+			Measure(options, output, "Matrix::TransformVector", [&](size_t i)
+				{
+					return Sum(inputs.matrices[i].TransformVector(inputs.vectors[i]));
+				});
+			Measure(options, output, "Vector3::Dot", [&](size_t i)
+				{
+					return Vector3::Dot(inputs.vectors[i], inputs.normals[i]);
+				});
+			Measure(options, output, "Vector3::Cross", [&](size_t i)
+				{
+					return Sum(Vector3::Cross(inputs.vectors[i], inputs.normals[i]));
+				});
+			Measure(options, output, "Vector3::Normalized", [&](size_t i)
+				{
+					return Sum(inputs.vectors[i].Normalized());
+				});
+#pragma endregion
+
+			return isValid;
+		}
+	}
+}
@@ -0,0 +1,30 @@
+//Standard includes
+#include <string>
+
+//Project includes
+#include "Benchmark.h"
+#include "CommandLine.h"
+
+using namespace dae;
+
+int main(int argc, char* args[])
+{
+	Benchmark::MicroOptions options{};
+
+	CommandLine commandLine{ "RayTracerMicroBenchmark" };
+	commandLine.AddInt("--warmup", "count", "unmeasured repetitions per kernel, default 3", 0, options.warmUpRepetitionCount);
+	commandLine.AddInt("--repetitions", "count", "measured repetitions per kernel, default 15", 1, options.repetitionCount);
+	commandLine.AddInt("--calls", "count", "calls per repetition, default 1000000", 1, options.callCount);
+	commandLine.AddString("--kernel", "filter", "only run the kernels whose name contains filter", options.kernelFilter);
+	switch (commandLine.Parse(argc, args))
+	{
+	case CommandLine::ParseResult::Help:
+		return 0;
+	case CommandLine::ParseResult::Error:
+		return 1;
+	case CommandLine::ParseResult::Run:
+		break;
+	}
+
+	return Benchmark::RunMicroBenchmarks(options) ? 0 : 1;
+}
@@ -0,0 +1,479 @@
+#include "ObjLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <string>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+namespace dae
+{
+	namespace ObjLoader
+	{
+		namespace
+		{
+			//Chunks smaller than this are not worth a task
+			constexpr size_t g_MinChunkSize{ 256 * 1024 };
+			constexpr uint32_t g_ChunksPerThread{ 8 };
+
+			//What the faces of a chunk reference of one kind of vertex data (v, vt or vn). Whether the references are in range
+			//is only known once the chunks before it are counted, so a chunk keeps its worst references and their lines
+			struct References
+			{
+				size_t count{}; //Elements defined in the chunk so far
+				long long maxIndex{}; //Largest 1 based index
+				long long maxReach{}; //How far a negative (relative) index reaches back before the first element of the chunk
+				const char* pMaxIndexLine{};
+				const char* pMaxReachLine{};
+
+				void Add(long long index, const char* pLine)
+				{
+					if (index > maxIndex)
+					{
+						maxIndex = index;
+						pMaxIndexLine = pLine;
+					}
+
+					const long long reach{ -index - static_cast<long long>(count) };
+					if (index < 0 && reach > maxReach)
+					{
+						maxReach = reach;
+						pMaxReachLine = pLine;
+					}
+				}
+			};
+
+			//One line aligned slice of the file, parsed on its own
+			struct Chunk
+			{
+				const char* pBegin{};
+				const char* pEnd{};
+
+				std::vector<Vector3> positions{};
+				//Triangulated and 0 based. Negative OBJ indices are stored relative to the first vertex of the chunk
+				//and listed in relativeIndexSlots, they get the vertex offset of the chunk once every chunk is parsed
+				std::vector<int> indices{};
+				std::vector<uint32_t> relativeIndexSlots{};
+				size_t vertexOffset{};
+				size_t indexOffset{};
+
+				References positionReferences{};
+				References textureCoordinateReferences{};
+				References normalReferences{};
+
+				//First malformed line of the chunk, nullptr while there is none
+				const char* pErrorLine{};
+				const char* pErrorReason{};
+
+				void SetError(const char* pLine, const char* pReason)
+				{
+					if (!pErrorLine || pLine < pErrorLine)
+					{
+						pErrorLine = pLine;
+						pErrorReason = pReason;
+					}
+				}
+
+				//count of the chunks before and of the whole file
+				void CheckReferences(const References& references, size_t countBefore, size_t totalCount, const char* pReason)
+				{
+					if (references.maxIndex > static_cast<long long>(totalCount))
+						SetError(references.pMaxIndexLine, pReason);
+					if (references.maxReach > static_cast<long long>(countBefore))
+						SetError(references.pMaxReachLine, pReason);
+				}
+			};
+
+			bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+			bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+			const char* SkipSpaces(const char* p, const char* pEnd)
+			{
+				while (p < pEnd && IsSpace(*p))
+				{
+					++p;
+				}
+				return p;
+			}
+
+			const char* SkipLine(const char* p, const char* pEnd)
+			{
+				const void* pNewLine{ std::memchr(p, '\n', pEnd - p) };
+				return pNewLine ? static_cast<const char*>(pNewLine) + 1 : pEnd;
+			}
+
+			//[+-]digits[.digits][(e|E)[+-]digits], up to 19 significant digits are kept (more than a float holds)
+			bool ParseFloat(const char*& p, const char* pEnd, float& value)
+			{
+				static constexpr double powersOf10[]{ 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+					1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+				constexpr int maxPower{ 22 };
+
+				const char* q{ SkipSpaces(p, pEnd) };
+				bool isNegative{ false };
+				if (q < pEnd && (*q == '-' || *q == '+'))
+				{
+					isNegative = *q == '-';
+					++q;
+				}
+
+				uint64_t mantissa{};
+				int digitCount{};
+				int exponent{};
+				bool hasDigits{ false };
+				for (; q < pEnd && IsDigit(*q); ++q)
+				{
+					hasDigits = true;
+					if (digitCount < 19)
+					{
+						mantissa = mantissa * 10 + (*q - '0');
+						digitCount += mantissa != 0;
+					}
+					else
+						++exponent;
+				}
+				if (q < pEnd && *q == '.')
+				{
+					for (++q; q < pEnd && IsDigit(*q); ++q)
+					{
+						hasDigits = true;
+						if (digitCount < 19)
+						{
+							mantissa = mantissa * 10 + (*q - '0');
+							digitCount += mantissa != 0;
+							--exponent;
+						}
+					}
+				}
+				if (!hasDigits)
+					return false;
+
+				if (q < pEnd && (*q == 'e' || *q == 'E'))
+				{
+					const char* pExponent{ q + 1 };
+					bool isExponentNegative{ false };
+					if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+					{
+						isExponentNegative = *pExponent == '-';
+						++pExponent;
+					}
+					if (pExponent < pEnd && IsDigit(*pExponent))
+					{
+						int exponentValue{};
+						for (; pExponent < pEnd && IsDigit(*pExponent); ++pExponent)
+						{
+							exponentValue = std::min(exponentValue * 10 + (*pExponent - '0'), 1000);
+						}
+						exponent += isExponentNegative ? -exponentValue : exponentValue;
+						q = pExponent;
+					}
+				}
+
+				double result{ static_cast<double>(mantissa) };
+				if (mantissa != 0)
+				{
+					for (; exponent > maxPower; exponent -= maxPower)
+					{
+						result *= powersOf10[maxPower];
+					}
+					for (; exponent < -maxPower; exponent += maxPower)
+					{
+						result /= powersOf10[maxPower];
+					}
+					result = exponent < 0 ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+				}
+
+				value = static_cast<float>(isNegative ? -result : result);
+				p = q;
+				return true;
+			}
+
+			bool ParseIndex(const char*& p, const char* pEnd, long long& value)
+			{
+				const char* q{ p };
+				const bool isNegative{ q < pEnd && *q == '-' };
+				if (isNegative)
+					++q;
+
+				long long result{};
+				const char* pDigits{ q };
+				for (; q < pEnd && IsDigit(*q); ++q)
+				{
+					if (q - pDigits >= 18)
+						return false;
+					result = result * 10 + (*q - '0');
+				}
+				if (q == pDigits)
+					return false;
+
+				value = isNegative ? -result : result;
+				p = q;
+				return true;
+			}
+
+			//Reads the corners after "f", each one v, v/vt, v//vn or v/vt/vn, and writes a triangle fan
+			bool ParseFace(const char*& p, const char* pEnd, const char* pLine, Chunk& chunk)
+			{
+				struct Corner
+				{
+					int index{};
+					bool isRelative{};
+				};
+
+				const auto pushCorner = [&](const Corner& corner)
+					{
+						if (corner.isRelative)
+							chunk.relativeIndexSlots.push_back(static_cast<uint32_t>(chunk.indices.size()));
+						chunk.indices.push_back(corner.index);
+					};
+
+				Corner first{};
+				Corner previous{};
+				int cornerCount{};
+				while (true)
+				{
+					p = SkipSpaces(p, pEnd);
+					if (p >= pEnd || *p == '\n' || *p == '#')
+						break;
+
+					long long index{};
+					if (!ParseIndex(p, pEnd, index) || index == 0)
+						return false;
+					chunk.positionReferences.Add(index, pLine);
+
+					//Texture coordinate and normal indices are only checked, the renderer does not use them
+					if (p < pEnd && *p == '/')
+					{
+						++p;
+						long long attributeIndex{};
+						if (p < pEnd && *p != '/')
+						{
+							if (!ParseIndex(p, pEnd, attributeIndex) || attributeIndex == 0)
+								return false;
+							chunk.textureCoordinateReferences.Add(attributeIndex, pLine);
+						}
+						if (p < pEnd && *p == '/')
+						{
+							++p;
+							if (!ParseIndex(p, pEnd, attributeIndex) || attributeIndex == 0)
+								return false;
+							chunk.normalReferences.Add(attributeIndex, pLine);
+						}
+					}
+					if (p < pEnd && !IsSpace(*p) && *p != '\n')
+						return false;
+
+					Corner corner{};
+					if (index > 0 && index <= INT_MAX)
+						corner.index = static_cast<int>(index - 1);
+					else if (index < 0 && -index <= INT_MAX)
+						corner = { static_cast<int>(static_cast<long long>(chunk.positions.size()) + index), true };
+					else
+						return false;
+
+					if (cornerCount == 0)
+						first = corner;
+					else if (cornerCount >= 2)
+					{
+						pushCorner(first);
+						pushCorner(previous);
+						pushCorner(corner);
+					}
+					previous = corner;
+					++cornerCount;
+				}
+				return cornerCount >= 3;
+			}
+
+			void ParseChunk(Chunk& chunk)
+			{
+				//Rough guess from the size, a triangle mesh has about two faces per vertex and a face line is around 30 bytes
+				const size_t byteCount{ static_cast<size_t>(chunk.pEnd - chunk.pBegin) };
+				chunk.positions.reserve(byteCount / 90);
+				chunk.indices.reserve(byteCount / 30 * 3);
+
+				const char* p{ chunk.pBegin };
+				while (p < chunk.pEnd)
+				{
+					const char* pLine{ p };
+					p = SkipSpaces(p, chunk.pEnd);
+					if (p + 1 < chunk.pEnd && IsSpace(p[1]))
+					{
+						if (*p == 'v')
+						{
+							++p;
+							Vector3 position{};
+							if (!ParseFloat(p, chunk.pEnd, position.x) || !ParseFloat(p, chunk.pEnd, position.y) || !ParseFloat(p, chunk.pEnd, position.z))
+							{
+								chunk.SetError(pLine, "malformed vertex");
+								return;
+							}
+							chunk.positions.emplace_back(position);
+							++chunk.positionReferences.count;
+						}
+						else if (*p == 'f')
+						{
+							++p;
+							if (!ParseFace(p, chunk.pEnd, pLine, chunk))
+							{
+								chunk.SetError(pLine, "malformed face (corners are v, v/vt, v//vn or v/vt/vn)");
+								return;
+							}
+						}
+					}
+					else if (p + 2 < chunk.pEnd && *p == 'v' && IsSpace(p[2]))
+					{
+						//Only counted, so the faces can be checked against them
+						if (p[1] == 't')
+							++chunk.textureCoordinateReferences.count;
+						else if (p[1] == 'n')
+							++chunk.normalReferences.count;
+					}
+					//Everything else (comments, groups, materials, an optional w) is skipped with the rest of the line
+					p = SkipLine(p, chunk.pEnd);
+				}
+			}
+
+			//Runs func(chunk) for every chunk, in parallel when there is a pool
+			template<typename Func>
+			void ForEachChunk(ThreadPool* pThreadPool, std::vector<Chunk>& chunks, const Func& func)
+			{
+				ParallelForBlocks(pThreadPool, chunks.size(), 1, [&](size_t first, size_t end)
+					{
+						for (size_t i{ first }; i < end; ++i)
+						{
+							func(chunks[i]);
+						}
+					});
+			}
+
+			std::vector<Chunk> CreateChunks(const char* pData, size_t size, uint32_t threadCount)
+			{
+				const size_t chunkCount{ std::clamp<size_t>(size / g_MinChunkSize, 1, static_cast<size_t>(threadCount) * g_ChunksPerThread) };
+
+				std::vector<Chunk> chunks{};
+				chunks.reserve(chunkCount);
+				const char* pBegin{ pData };
+				const char* pFileEnd{ pData + size };
+				for (size_t i{ 1 }; i <= chunkCount && pBegin < pFileEnd; ++i)
+				{
+					//Every chunk ends right after a line end, so no line is split
+					const char* pEnd{ i == chunkCount ? pFileEnd : std::max(pBegin, pData + size * i / chunkCount) };
+					pEnd = SkipLine(pEnd, pFileEnd);
+
+					Chunk& chunk{ chunks.emplace_back() };
+					chunk.pBegin = pBegin;
+					chunk.pEnd = pEnd;
+					pBegin = pEnd;
+				}
+				return chunks;
+			}
+		}
+
+		bool Load(const std::string& path, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices,
+			ThreadPool* pThreadPool, LoadStats* pStats)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			positions.clear();
+			normals.clear();
+			indices.clear();
+
+			MappedFile file{};
+			if (!file.Open(path))
+			{
+				if (pStats)
+					pStats->error = path + ": can not be opened";
+				return false;
+			}
+
+			const uint32_t threadCount{ pThreadPool ? pThreadPool->GetThreadCount() : 1 };
+			std::vector<Chunk> chunks{ CreateChunks(file.GetData(), file.GetSize(), threadCount) };
+			const uint32_t chunkCount{ static_cast<uint32_t>(chunks.size()) };
+			ForEachChunk(pThreadPool, chunks, ParseChunk);
+
+			//Every chunk starts where the chunks before it end
+			size_t vertexCount{};
+			size_t indexCount{};
+			size_t textureCoordinateCount{};
+			size_t normalCount{};
+			for (Chunk& chunk : chunks)
+			{
+				chunk.vertexOffset = vertexCount;
+				chunk.indexOffset = indexCount;
+				vertexCount += chunk.positions.size();
+				indexCount += chunk.indices.size();
+				textureCoordinateCount += chunk.textureCoordinateReferences.count;
+				normalCount += chunk.normalReferences.count;
+			}
+
+			//Now every face index can be checked, the first error in file order is reported
+			size_t textureCoordinatesBefore{};
+			size_t normalsBefore{};
+			for (Chunk& chunk : chunks)
+			{
+				chunk.CheckReferences(chunk.positionReferences, chunk.vertexOffset, vertexCount, "vertex index out of range");
+				chunk.CheckReferences(chunk.textureCoordinateReferences, textureCoordinatesBefore, textureCoordinateCount, "texture coordinate index out of range");
+				chunk.CheckReferences(chunk.normalReferences, normalsBefore, normalCount, "normal index out of range");
+				textureCoordinatesBefore += chunk.textureCoordinateReferences.count;
+				normalsBefore += chunk.normalReferences.count;
+
+				if (chunk.pErrorLine)
+				{
+					if (pStats)
+					{
+						const size_t line{ 1 + static_cast<size_t>(std::count(file.GetData(), chunk.pErrorLine, '\n')) };
+						pStats->error = path + ':' + std::to_string(line) + ": " + chunk.pErrorReason;
+					}
+					return false;
+				}
+			}
+			if (vertexCount > INT_MAX)
+			{
+				if (pStats)
+					pStats->error = path + ": more than INT_MAX vertices";
+				return false;
+			}
+
+			positions.resize(vertexCount);
+			indices.resize(indexCount);
+			ForEachChunk(pThreadPool, chunks, [&](Chunk& chunk)
+				{
+					for (const uint32_t slot : chunk.relativeIndexSlots)
+					{
+						chunk.indices[slot] += static_cast<int>(chunk.vertexOffset);
+					}
+
+					std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.vertexOffset);
+					std::copy(chunk.indices.begin(), chunk.indices.end(), indices.begin() + chunk.indexOffset);
+				});
+
+			//Face normals, once every position is in place
+			normals.resize(indexCount / 3);
+			ForEachChunk(pThreadPool, chunks, [&](const Chunk& chunk)
+				{
+					const size_t lastIndex{ chunk.indexOffset + chunk.indices.size() };
+					for (size_t index{ chunk.indexOffset }; index < lastIndex; index += 3)
+					{
+						const Vector3& v0{ positions[indices[index]] };
+						const Vector3 edgeV0V1{ positions[indices[index + 1]] - v0 };
+						const Vector3 edgeV0V2{ positions[indices[index + 2]] - v0 };
+						normals[index / 3] = Vector3::Cross(edgeV0V1, edgeV0V2).Normalized();
+					}
+				});
+
+			if (pStats)
+			{
+				pStats->byteCount = file.GetSize();
+				pStats->vertexCount = vertexCount;
+				pStats->triangleCount = indexCount / 3;
+				pStats->chunkCount = chunkCount;
+				pStats->threadCount = threadCount;
+				pStats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Math.h"
+
+namespace dae
+{
+	class ThreadPool;
+
+	namespace ObjLoader
+	{
+		//What a load did and how long it took (file mapping, parsing, merging and face normals)
+		struct LoadStats
+		{
+			size_t byteCount{};
+			size_t vertexCount{};
+			size_t triangleCount{};
+			uint32_t chunkCount{};
+			uint32_t threadCount{}; //Of the pool, 1 without one
+			double milliseconds{};
+			//Why Load returned false ("<path>:<line>: <reason>"), empty when it did not
+			std::string error{};
+
+			double GetMegabytesPerSecond() const { return milliseconds > 0. ? byteCount / (milliseconds * 1e3) : 0.; }
+		};
+
+		/**
+		 * \brief Loads the triangles of a Wavefront OBJ file. The file is memory mapped and split into chunks at line ends,
+		 * the chunks are parsed in parallel and merged in file order. Faces accept every OBJ corner syntax (v, v/vt, v//vn, v/vt/vn),
+		 * negative (relative) indices, and quads or larger polygons, which are triangulated as a fan.
+		 * Texture coordinates and vertex normals are skipped (their indices are range checked), the renderer shades with face normals
+		 * \param path OBJ file
+		 * \param positions replaced by the vertex positions, in file order
+		 * \param normals replaced by one normalized face normal per triangle, (v1 - v0) x (v2 - v0)
+		 * \param indices replaced by three 0 based position indices per triangle
+		 * \param pThreadPool parses the chunks in parallel when given, nullptr parses them on the calling thread
+		 * \param pStats optional, filled with the sizes and the load time, or with the error when the load fails
+		 * \return false when the file can not be opened or holds a malformed vertex or face (the vectors are left empty)
+		 */
+		bool Load(const std::string& path, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices,
+			ThreadPool* pThreadPool = nullptr, LoadStats* pStats = nullptr);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cfloat>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	struct Ray
+	{
+		Vector3 origin{};
+		Vector3 direction{};
+
+		float min{ 0.0001f };
+		float max{ FLT_MAX };
+	};
+}
@@ -0,0 +1,29 @@
+#include "RayGenerator.h"
+
+#include <cmath>
+
+namespace dae
+{
+	RayGenerator::RayGenerator(const Camera& camera, int width, int height, float sampleOffsetX, float sampleOffsetY, float lensX, float lensY) :
+		m_Projection{ camera.projection },
+		m_Origin{ camera.origin },
+		m_Forward{ camera.forward }
+	{
+		const float aspectRatio{ static_cast<float>(width) / height };
+
+		//Half extents of the image plane (one unit in front of the camera) or of the orthographic screen
+		const float halfHeight{ m_Projection == ProjectionType::Orthographic ? camera.orthographicSize : std::tan(camera.fovAngle / 2.f * TO_RADIANS) };
+		const float halfWidth{ halfHeight * aspectRatio };
+
+		m_PixelStepX = (2.f * halfWidth / width) * camera.right;
+		m_PixelStepY = (-2.f * halfHeight / height) * camera.up;
+
+		//Top left corner of the image, moved to the sample position within pixel (0, 0)
+		const Vector3 center{ m_Projection == ProjectionType::Orthographic ? camera.origin : camera.forward };
+		m_PixelOrigin = center - halfWidth * camera.right + halfHeight * camera.up + sampleOffsetX * m_PixelStepX + sampleOffsetY * m_PixelStepY;
+
+		m_FocusDistance = camera.focusDistance;
+		m_LensOffset = camera.apertureRadius * (lensX * camera.right + lensY * camera.up);
+		m_LensOrigin = camera.origin + m_LensOffset;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "Camera.h"
+#include "Ray.h"
+
+namespace dae
+{
+	//Primary ray setup of one frame: the image plane and the step from one pixel to the next are computed once,
+	//a ray is then an affine function of the pixel coordinates for every projection
+	class RayGenerator final
+	{
+	public:
+		RayGenerator() = default;
+
+		/**
+		 * \brief Precomputes the image plane of a camera
+		 * \param camera camera to generate rays for (projection, basis, fov)
+		 * \param width image width in pixels
+		 * \param height image height in pixels
+		 * \param sampleOffsetX subpixel position of the sample within every pixel, [0, 1)
+		 * \param sampleOffsetY subpixel position of the sample within every pixel, [0, 1)
+		 * \param lensX lens position within the unit disk (thin lens only), the same for every pixel of the frame
+		 * \param lensY lens position within the unit disk (thin lens only)
+		 */
+		RayGenerator(const Camera& camera, int width, int height,
+			float sampleOffsetX = .5f, float sampleOffsetY = .5f, float lensX = 0.f, float lensY = 0.f);
+
+		Ray GetRay(int px, int py) const
+		{
+			//Pinhole and thin lens: direction through the image plane one unit in front of the camera
+			//Orthographic: origin on the screen rectangle
+			const Vector3 pixelPoint{ m_PixelOrigin + static_cast<float>(px) * m_PixelStepX + static_cast<float>(py) * m_PixelStepY };
+
+			switch (m_Projection)
+			{
+			case ProjectionType::Orthographic:
+				return Ray{ pixelPoint, m_Forward };
+			case ProjectionType::ThinLens:
+				//Aim at the point of the focus plane the lens center sees, so that plane stays sharp for every lens position
+				return Ray{ m_LensOrigin, (m_FocusDistance * pixelPoint - m_LensOffset).Normalized() };
+			default:
+				return Ray{ m_Origin, pixelPoint.Normalized() };
+			}
+		}
+
+	private:
+		ProjectionType m_Projection{};
+		Vector3 m_Origin{};
+		Vector3 m_Forward{ Vector3::UnitZ };
+
+		Vector3 m_PixelOrigin{}; //Point of pixel (0, 0), sample offset included
+		Vector3 m_PixelStepX{}; //One pixel to the right
+		Vector3 m_PixelStepY{}; //One pixel down
+
+		//Thin lens
+		Vector3 m_LensOffset{}; //Lens position relative to the camera origin
+		Vector3 m_LensOrigin{};
+		float m_FocusDistance{};
+	};
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cfloat>
+
+#include "Ray.h"
+#include "Simd.h"
+
+namespace dae
+{
+	//SIMD_WIDTH rays traced together, lane i is the i-th ray
+	struct RayPacket
+	{
+		RayPacket() = default;
+
+		/**
+		 * \param pRays rays to pack
+		 * \param rayCount number of rays (<= SIMD_WIDTH), remaining lanes are disabled
+		 */
+		RayPacket(const Ray* pRays, int rayCount)
+		{
+			float lanes[7][SIMD_WIDTH]{};
+			for (int lane{}; lane < SIMD_WIDTH; ++lane)
+			{
+				//Unused lanes copy the first ray, so they never produce NaNs, but get a negative tMax
+				const Ray& ray{ pRays[lane < rayCount ? lane : 0] };
+				lanes[0][lane] = ray.origin.x;
+				lanes[1][lane] = ray.origin.y;
+				lanes[2][lane] = ray.origin.z;
+				lanes[3][lane] = ray.direction.x;
+				lanes[4][lane] = ray.direction.y;
+				lanes[5][lane] = ray.direction.z;
+				lanes[6][lane] = lane < rayCount ? ray.max : -FLT_MAX;
+			}
+
+			origin = { SimdFloat::Load(lanes[0]), SimdFloat::Load(lanes[1]), SimdFloat::Load(lanes[2]) };
+			direction = { SimdFloat::Load(lanes[3]), SimdFloat::Load(lanes[4]), SimdFloat::Load(lanes[5]) };
+			invDirection = { SimdFloat{ 1.f } / direction.x, SimdFloat{ 1.f } / direction.y, SimdFloat{ 1.f } / direction.z };
+			tMin = pRays[0].min;
+			tMax = SimdFloat::Load(lanes[6]);
+		}
+
+		SimdVector3 origin{};
+		SimdVector3 direction{};
+		SimdVector3 invDirection{};
+
+		float tMin{ 0.0001f };
+		//Shrinks to the closest hit of every lane, negative for disabled lanes
+		SimdFloat tMax{ FLT_MAX };
+
+		Ray GetRay(int lane) const
+		{
+			return Ray{ { origin.x[lane], origin.y[lane], origin.z[lane] },
+				{ direction.x[lane], direction.y[lane], direction.z[lane] },
+				tMin, tMax[lane] };
+		}
+
+		int GetActiveMask() const
+		{
+			return SimdFloat::MoveMask(tMax >= SimdFloat{ tMin });
+		}
+
+		//Front to back traversal is only ordered for every lane when all active directions share their signs
+		bool IsCoherent() const
+		{
+			const int activeMask{ GetActiveMask() };
+			const SimdFloat zero{};
+			for (const SimdFloat& component : { direction.x, direction.y, direction.z })
+			{
+				const int negativeMask{ SimdFloat::MoveMask(component < zero) & activeMask };
+				if (negativeMask != 0 && negativeMask != activeMask)
+					return false;
+			}
+			return true;
+		}
+	};
+}
@@ -1,123 +1,451 @@
 //External includes
+#ifndef RAYTRACER_HEADLESS
 #include "SDL.h"
 #include "SDL_surface.h"
+#endif
 
 //Project includes
 #include "Renderer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
+#include "Image.h"
 #include "Math.h"
 #include "Matrix.h"
 #include "Material.h"
+#include "RayPacket.h"
 #include "Scene.h"
+#include "ThreadPool.h"
 #include "Utils.h"
 
 using namespace dae;
 
-Renderer::Renderer(SDL_Window * pWindow) :
-	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+namespace
+{
+	//Radical inverse of index in base, successive indices fill [0, 1) evenly (Halton sequence)
+	float GetHalton(uint32_t index, uint32_t base)
+	{
+		float result{};
+		float fraction{ 1.f / base };
+		while (index > 0)
+		{
+			result += fraction * (index % base);
+			index /= base;
+			fraction /= base;
+		}
+		return result;
+	}
+}
+
+#ifndef RAYTRACER_HEADLESS
+Renderer::Renderer(SDL_Window * pWindow, uint32_t threadCount) :
+	m_pWindow(pWindow)
 {
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
-	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	Initialize(threadCount);
 }
+#endif
 
-void Renderer::Render(Scene* pScene) const
+Renderer::Renderer(int width, int height, uint32_t threadCount) :
+	m_Width(width),
+	m_Height(height)
 {
-	Render(pScene, 0, m_Width, 0, m_Height);
+	Initialize(threadCount);
 }
 
-void Renderer::Render(Scene * pScene, const int fromX, const int toX, const int fromY, const int toY) const
+void Renderer::Initialize(uint32_t threadCount)
 {
-	Camera& camera = pScene->GetCamera();
-	auto& materials = pScene->GetMaterials();
-	auto& lights = pScene->GetLights();
+	m_pThreadPool = std::make_unique<ThreadPool>(threadCount);
+
+	m_Buffer.resize(static_cast<size_t>(m_Width) * m_Height);
+	m_pBufferPixels = m_Buffer.data();
+	m_GBuffer.resize(m_Buffer.size());
+	m_pGBufferPixels = m_GBuffer.data();
 
-	for (int px{fromX}; px < toX; ++px)
+	const int tileCountX{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const int tileCountY{ (m_Height + m_TileSize - 1) / m_TileSize };
+	m_TileCosts = std::vector<std::atomic<uint64_t>>(static_cast<size_t>(tileCountX * tileCountY));
+}
+
+Renderer::~Renderer() = default;
+
+void Renderer::Render(Scene* pScene)
+{
+	pScene->UpdateAccelerationStructure(m_pThreadPool.get());
+
+	//A moved camera or edited (or different) geometry has to be traced again,
+	//edited lights or materials start a new image from the G-buffer
+	Camera& camera{ pScene->GetCamera() };
+	if (camera.hasMoved || pScene->GetGeometryVersion() != m_GeometryVersion)
 	{
-		for (int py{fromY}; py < toY; ++py)
-		{
+		Invalidate();
+		camera.hasMoved = false;
+		m_GeometryVersion = pScene->GetGeometryVersion();
+	}
+	if (pScene->GetShadingVersion() != m_ShadingVersion)
+	{
+		RestartImage();
+		m_ShadingVersion = pScene->GetShadingVersion();
+	}
 
-            float ar{ float(m_Width * 1.f / m_Height) };
-            float FOV = tanf(camera.fovAngle / 2 * TO_RADIANS);
-
-            
-            float cX{ (2.f * ((px + 0.5f) / m_Width) - 1.f) * ar * FOV };
-            float cY{ (1.f - ((2.f * (py + 0.5f)) / m_Height)) * FOV };
-
-
-            const Matrix cameraToWorld = camera.CalculateCameraToWorld();
-            Vector3 rayDirection{ cX, cY, 1 };
-
-            rayDirection = cX * camera.right + cY * camera.up + 1.0f * camera.forward;
-			Vector3 normalRayDir{ rayDirection.Normalized() };
-
-
-            Ray viewRay{ camera.origin, normalRayDir };
-
-            ColorRGB finalColor{};
-
-            HitRecord closestHit{};
-
-            pScene->GetClosestHit(viewRay, closestHit);
-
-            if (closestHit.didHit)
-            {
-				auto material{ materials[closestHit.materialIndex] };
-	            for(unsigned long i{}; i < lights.size();++i)
-	            {
-					Vector3 directionToLight =  LightUtils::GetDirectionToLight(lights[i], closestHit.origin);
-					float mag{ directionToLight.Magnitude() };
-					directionToLight.Normalize();
-					float observedArea = Vector3::Dot(closestHit.normal, directionToLight);
-					Ray rayToLight = Ray{ closestHit.origin,directionToLight,0.0001f,mag };
-					if(observedArea >=0.f && ( !m_RenderShadows || !pScene->DoesHit(rayToLight)))
-					{
-						ColorRGB radiance = LightUtils::GetRadiance(lights[i], closestHit.origin);
-						ColorRGB BRDF = material->Shade(closestHit,directionToLight,-viewRay.direction);
-						
-						switch (m_currentLightingMode)
-						{
-						case LightingMode::ObservedArea:
-							finalColor +=  ColorRGB(1.f,1.f,1.f) * observedArea;
-							break;
-						case LightingMode::Radiance: 
-							finalColor += radiance ;
-							break;
-						case LightingMode::BRDF: 
-							finalColor +=  BRDF;
-							break;
-						case LightingMode::Combined: 
-							finalColor += radiance * observedArea * BRDF;
-							break;
-						}
-					}
-	            }
-            }
-
-			finalColor.MaxToOne();
-			//Update Color in Buffer
-			m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-				static_cast<uint8_t>(finalColor.r * 255),
-				static_cast<uint8_t>(finalColor.g * 255),
-				static_cast<uint8_t>(finalColor.b * 255));
-		}
+	//The image is finished (one sample, or converged when progressive), tracing again would give the same pixels
+	const uint32_t finalSampleCount{ m_IsProgressive ? m_MaxSampleCount : 1 };
+	if (m_SampleCount >= finalSampleCount)
+	{
+		Present();
+		return;
 	}
 
+	//The first sample is the pixel center through the lens center (same image as without accumulation),
+	//then a Halton(2, 3) pattern within the pixel and a Halton(5, 7) pattern over the lens
+	float sampleOffsetX{ .5f };
+	float sampleOffsetY{ .5f };
+	float lensX{};
+	float lensY{};
+	if (m_SampleCount > 0)
+	{
+		sampleOffsetX = GetHalton(m_SampleCount, 2);
+		sampleOffsetY = GetHalton(m_SampleCount, 3);
+
+		const float lensRadius{ std::sqrt(GetHalton(m_SampleCount, 5)) };
+		const float lensAngle{ GetHalton(m_SampleCount, 7) * PI_2 };
+		lensX = lensRadius * std::cos(lensAngle);
+		lensY = lensRadius * std::sin(lensAngle);
+	}
+	m_RayGenerator = RayGenerator{ camera, m_Width, m_Height, sampleOffsetX, sampleOffsetY, lensX, lensY };
+	m_IsReshading = m_SampleCount == 0 && m_IsGBufferValid;
+
+	//Expensive tiles first in every deque (threads pop from the back), idle threads steal what is left
+	std::vector<Tile> tiles{ CreateTiles() };
+	std::sort(tiles.begin(), tiles.end(), [](const Tile& a, const Tile& b) { return a.predictedCost < b.predictedCost; });
+
+	for (std::atomic<uint64_t>& tileCost : m_TileCosts)
+	{
+		tileCost = 0;
+	}
+
+	std::vector<ThreadPool::Task> tasks{};
+	tasks.reserve(tiles.size());
+	for (const Tile& tile : tiles)
+	{
+		tasks.emplace_back([this, pScene, tile] { RenderTile(pScene, tile); });
+	}
+	m_pThreadPool->RunTasks(tasks);
+
+	//Tracing the pixel centers filled the G-buffer
+	m_IsGBufferValid = m_IsGBufferValid || m_SampleCount == 0;
+	++m_SampleCount;
+
 	//@END
+	Present();
+}
+
+void Renderer::Present() const
+{
+#ifndef RAYTRACER_HEADLESS
+	if (!m_pWindow)
+		return;
+
 	//Update SDL Surface
+	SDL_Surface* pSurface{ SDL_GetWindowSurface(m_pWindow) };
+	SDL_ConvertPixels(m_Width, m_Height, SDL_PIXELFORMAT_RGB888, m_pBufferPixels, m_Width * static_cast<int>(sizeof(uint32_t)),
+		pSurface->format->format, pSurface->pixels, pSurface->pitch);
 	SDL_UpdateWindowSurface(m_pWindow);
+#endif
+}
+
+uint32_t Renderer::GetThreadCount() const
+{
+	return m_pThreadPool->GetThreadCount();
+}
+
+void Renderer::Render(const Scene * pScene, const int fromX, const int toX, const int fromY, const int toY) const
+{
+	Trace(pScene, RayGenerator{ pScene->GetCamera(), m_Width, m_Height }, fromX, toX, fromY, toY);
+}
+
+ColorRGB Renderer::TracePixel(const Scene* pScene, int px, int py, HitRecord& closestHit) const
+{
+	const Ray viewRay{ RayGenerator{ pScene->GetCamera(), m_Width, m_Height }.GetRay(px, py) };
+
+	closestHit = {};
+	pScene->GetClosestHit(viewRay, closestHit);
+	return ShadePixel(pScene, closestHit, viewRay.direction);
+}
+
+void Renderer::Trace(const Scene* pScene, const RayGenerator& rayGenerator, int fromX, int toX, int fromY, int toY) const
+{
+	if (!m_UsePacketTracing)
+	{
+		for (int px{fromX}; px < toX; ++px)
+		{
+			for (int py{fromY}; py < toY; ++py)
+			{
+				const Ray viewRay{ rayGenerator.GetRay(px, py) };
+
+				HitRecord closestHit{};
+				pScene->GetClosestHit(viewRay, closestHit);
+
+				WriteHit(pScene, px, py, closestHit, viewRay.direction);
+			}
+		}
+		return;
+	}
+
+	//Blocks of neighbouring pixels share a packet (4x2 on AVX, 2x2 on SSE), lane i is pixel (i % width, i / width)
+	constexpr int packetWidth{ SIMD_WIDTH / 2 };
+	constexpr int packetHeight{ 2 };
+
+	for (int blockY{fromY}; blockY < toY; blockY += packetHeight)
+	{
+		for (int blockX{fromX}; blockX < toX; blockX += packetWidth)
+		{
+			int pixelsX[SIMD_WIDTH]{};
+			int pixelsY[SIMD_WIDTH]{};
+			Ray viewRays[SIMD_WIDTH]{};
+			int rayCount{};
+			for (int y{blockY}; y < std::min(blockY + packetHeight, toY); ++y)
+			{
+				for (int x{blockX}; x < std::min(blockX + packetWidth, toX); ++x)
+				{
+					pixelsX[rayCount] = x;
+					pixelsY[rayCount] = y;
+					viewRays[rayCount] = rayGenerator.GetRay(x, y);
+					++rayCount;
+				}
+			}
+
+			HitRecord closestHits[SIMD_WIDTH]{};
+			RayPacket packet{ viewRays, rayCount };
+			if (packet.IsCoherent())
+			{
+				pScene->GetClosestHit(packet, closestHits);
+			}
+			else
+			{
+				//Lanes would disagree on the traversal order, trace them one by one
+				for (int i{}; i < rayCount; ++i)
+				{
+					pScene->GetClosestHit(viewRays[i], closestHits[i]);
+				}
+			}
+
+			for (int i{}; i < rayCount; ++i)
+			{
+				WriteHit(pScene, pixelsX[i], pixelsY[i], closestHits[i], viewRays[i].direction);
+			}
+		}
+	}
+}
+
+void Renderer::Reshade(const Scene* pScene, int fromX, int toX, int fromY, int toY) const
+{
+	for (int py{ fromY }; py < toY; ++py)
+	{
+		for (int px{ fromX }; px < toX; ++px)
+		{
+			const GBufferPixel& pixel{ m_pGBufferPixels[px + py * m_Width] };
+			WritePixel(px, py, ShadePixel(pScene, pixel.closestHit, pixel.viewDirection));
+		}
+	}
+}
+
+ColorRGB Renderer::ShadePixel(const Scene* pScene, const HitRecord& closestHit, const Vector3& viewDirection) const
+{
+	if (!closestHit.didHit)
+		return {};
+
+	//Dispatch on the material type once per hit, the light loop is compiled for every material type
+	return pScene->GetMaterials().Visit(closestHit.materialIndex, [&](const auto& material)
+		{
+			return ShadeLights(pScene, closestHit, viewDirection, material);
+		});
+}
+
+template<typename MaterialParameters>
+ColorRGB Renderer::ShadeLights(const Scene* pScene, const HitRecord& closestHit, const Vector3& viewDirection, const MaterialParameters& material) const
+{
+	ColorRGB finalColor{};
+	auto& lights = pScene->GetLights();
+
+	for(unsigned long i{}; i < lights.size();++i)
+	{
+		Vector3 directionToLight =  LightUtils::GetDirectionToLight(lights[i], closestHit.origin);
+		float mag{ directionToLight.Magnitude() };
+		directionToLight.Normalize();
+		float observedArea = Vector3::Dot(closestHit.normal, directionToLight);
+		Ray rayToLight = Ray{ closestHit.origin,directionToLight,0.0001f,mag };
+		if(observedArea >=0.f && ( !m_RenderShadows || !pScene->DoesHit(rayToLight)))
+		{
+			ColorRGB radiance = LightUtils::GetRadiance(lights[i], closestHit.origin);
+			ColorRGB BRDF = material.Shade(closestHit,directionToLight,-viewDirection);
+
+			switch (m_currentLightingMode)
+			{
+			case LightingMode::ObservedArea:
+				finalColor +=  ColorRGB(1.f,1.f,1.f) * observedArea;
+				break;
+			case LightingMode::Radiance: 
+				finalColor += radiance ;
+				break;
+			case LightingMode::BRDF: 
+				finalColor +=  BRDF;
+				break;
+			case LightingMode::Combined: 
+				finalColor += radiance * observedArea * BRDF;
+				break;
+			}
+		}
+	}
+
+	return finalColor;
+}
+
+void Renderer::WriteHit(const Scene* pScene, int px, int py, const HitRecord& closestHit, const Vector3& viewDirection) const
+{
+	//Only the pixel centers (first sample) are kept, a reshade has to reproduce the first sample exactly
+	if (m_SampleCount == 0)
+		m_pGBufferPixels[px + py * m_Width] = { closestHit, viewDirection };
+
+	WritePixel(px, py, ShadePixel(pScene, closestHit, viewDirection));
+}
+
+void Renderer::WritePixel(int px, int py, ColorRGB finalColor) const
+{
+	finalColor.MaxToOne();
+
+	const size_t pixelIndex{ static_cast<size_t>(px) + static_cast<size_t>(py) * m_Width };
+	if (m_IsProgressive)
+	{
+		//Sum the displayed samples, so the first frame matches the non progressive image exactly
+		ColorRGB& sum{ m_pAccumulationPixels[pixelIndex] };
+		if (m_SampleCount == 0)
+			sum = finalColor;
+		else
+			sum += finalColor;
+
+		const float weight{ 1.f / (m_SampleCount + 1) };
+		finalColor = ColorRGB{ sum.r * weight, sum.g * weight, sum.b * weight };
+	}
+
+	//Update Color in Buffer
+	m_pBufferPixels[pixelIndex] =
+		static_cast<uint32_t>(static_cast<uint8_t>(finalColor.r * 255)) << 16 |
+		static_cast<uint32_t>(static_cast<uint8_t>(finalColor.g * 255)) << 8 |
+		static_cast<uint32_t>(static_cast<uint8_t>(finalColor.b * 255));
+}
+
+std::vector<Renderer::Tile> Renderer::CreateTiles() const
+{
+	const int tileCountX{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const int tileCountY{ (m_Height + m_TileSize - 1) / m_TileSize };
+
+	uint64_t totalCost{};
+	for (const std::atomic<uint64_t>& tileCost : m_TileCosts)
+	{
+		totalCost += tileCost;
+	}
+
+	//Aim for a few tasks per thread, so the last tasks of the frame are small enough to balance out
+	const float targetCost{ static_cast<float>(totalCost) / (m_pThreadPool->GetThreadCount() * m_TasksPerThread) };
+
+	std::vector<Tile> tiles{};
+	tiles.reserve(m_TileCosts.size());
+	for (int tileY{}; tileY < tileCountY; ++tileY)
+	{
+		for (int tileX{}; tileX < tileCountX; ++tileX)
+		{
+			Tile tile{};
+			tile.fromX = tileX * m_TileSize;
+			tile.toX = std::min(tile.fromX + m_TileSize, m_Width);
+			tile.fromY = tileY * m_TileSize;
+			tile.toY = std::min(tile.fromY + m_TileSize, m_Height);
+			tile.baseTileIndex = static_cast<uint32_t>(tileX + tileY * tileCountX);
+			tile.predictedCost = static_cast<float>(m_TileCosts[tile.baseTileIndex]);
+
+			SplitTile(tile, targetCost, tiles);
+		}
+	}
+
+	return tiles;
+}
+
+void Renderer::SplitTile(const Tile& tile, float targetCost, std::vector<Tile>& tiles) const
+{
+	const int width{ tile.toX - tile.fromX };
+	const int height{ tile.toY - tile.fromY };
+	const bool canSplitX{ width >= 2 * m_MinTileSize };
+	const bool canSplitY{ height >= 2 * m_MinTileSize };
+
+	//The first frame has no measurements (targetCost 0), tiles are kept as they are
+	if (tile.predictedCost <= targetCost || (!canSplitX && !canSplitY))
+	{
+		tiles.emplace_back(tile);
+		return;
+	}
+
+	//Split in halves along each axis that is large enough, assuming the cost is spread evenly over the tile
+	const int middleX{ canSplitX ? tile.fromX + width / 2 : tile.toX };
+	const int middleY{ canSplitY ? tile.fromY + height / 2 : tile.toY };
+	const float childCost{ tile.predictedCost / ((canSplitX ? 2 : 1) * (canSplitY ? 2 : 1)) };
+
+	const int xRanges[2][2]{ { tile.fromX, middleX }, { middleX, tile.toX } };
+	const int yRanges[2][2]{ { tile.fromY, middleY }, { middleY, tile.toY } };
+	for (const auto& yRange : yRanges)
+	{
+		for (const auto& xRange : xRanges)
+		{
+			if (xRange[0] == xRange[1] || yRange[0] == yRange[1])
+				continue;
+
+			Tile child{ tile };
+			child.fromX = xRange[0];
+			child.toX = xRange[1];
+			child.fromY = yRange[0];
+			child.toY = yRange[1];
+			child.predictedCost = childCost;
+			SplitTile(child, targetCost, tiles);
+		}
+	}
 }
 
-bool Renderer::SaveBufferToImage() const
+void Renderer::RenderTile(const Scene* pScene, const Tile& tile)
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	const auto start{ std::chrono::steady_clock::now() };
+	if (m_IsReshading)
+		Reshade(pScene, tile.fromX, tile.toX, tile.fromY, tile.toY);
+	else
+		Trace(pScene, m_RayGenerator, tile.fromX, tile.toX, tile.fromY, tile.toY);
+	const auto duration{ std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start) };
+
+	//Split tiles add up again, next frame splits the base tile based on its total cost
+	m_TileCosts[tile.baseTileIndex] += static_cast<uint64_t>(duration.count());
+}
+
+bool Renderer::SaveBufferToImage(const std::string& path) const
+{
+	return Image::Save(path, m_pBufferPixels, m_Width, m_Height);
+}
+
+void Renderer::ToggleProgressive()
+{
+	m_IsProgressive = !m_IsProgressive;
+	RestartImage();
+
+	if (m_AccumulationBuffer.empty())
+	{
+		m_AccumulationBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+		m_pAccumulationPixels = m_AccumulationBuffer.data();
+	}
 }
 
 void Renderer::CycleLightingMode()
 {
+	RestartImage();
+
 	switch (m_currentLightingMode)
 	{
 		case LightingMode::ObservedArea:
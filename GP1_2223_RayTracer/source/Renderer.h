@@ -1,30 +1,73 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DataTypes.h"
+#include "RayGenerator.h"
 
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace dae
 {
+	struct Camera;
 	class Scene;
+	class ThreadPool;
 
 	class Renderer final
 	{
 	public:
-		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
-		void ToggleShadows() { m_RenderShadows = !m_RenderShadows; }
+		//threadCount 0 renders on every hardware thread
+#ifndef RAYTRACER_HEADLESS
+		//Presents every frame to the window surface
+		Renderer(SDL_Window* pWindow, uint32_t threadCount = 0);
+#endif
+		//Headless, frames only end up in the framebuffer (see GetBuffer and SaveBufferToImage)
+		Renderer(int width, int height, uint32_t threadCount = 0);
+		~Renderer();
+		//Render settings only change the shading, the next frame reshades the G-buffer instead of tracing
+		void ToggleShadows() { m_RenderShadows = !m_RenderShadows; RestartImage(); }
 		void CycleLightingMode();
+		void TogglePacketTracing() { m_UsePacketTracing = !m_UsePacketTracing; }
+		//Progressive: every frame adds one jittered sample per pixel to a float buffer and shows the average,
+		//the accumulation restarts when the camera moves or a render setting changes
+		void ToggleProgressive();
+		bool IsProgressive() const { return m_IsProgressive; }
+		uint32_t GetSampleCount() const { return m_SampleCount; }
+		//Render skips tracing while the camera, the scene and the render settings are unchanged (it only presents),
+		//this forces the next frame to trace every pixel again (e.g. to time repeated frames)
+		void Invalidate() { RestartImage(); m_IsGBufferValid = false; }
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void Render(Scene* pScene, int fromX, int toX, int fromY, int toY) const;
-		bool SaveBufferToImage() const;
+		//Renders the full frame in tiles on the thread pool and presents it (when there is a window)
+		//Nothing is traced when the finished image is still valid (see Invalidate)
+		void Render(Scene* pScene);
+		//Renders a sub-rectangle (pixel centers) on the calling thread, safe to call concurrently for disjoint rectangles
+		void Render(const Scene* pScene, int fromX, int toX, int fromY, int toY) const;
+		/**
+		 * \brief Traces and shades the center of one pixel for debugging, the framebuffer, G-buffer and accumulation stay untouched
+		 * \param closestHit receives the closest hit of the pixel
+		 * \return shaded color of the pixel, before clamping
+		 */
+		ColorRGB TracePixel(const Scene* pScene, int px, int py, HitRecord& closestHit) const;
+		//Returns true when the image was written, .ppm paths are written as PPM, everything else as BMP
+		bool SaveBufferToImage(const std::string& path = "RayTracing_Buffer.bmp") const;
+
+		//Framebuffer of the last frame, 0x00RRGGBB, rows top to bottom
+		const uint32_t* GetBuffer() const { return m_pBufferPixels; }
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		uint32_t GetThreadCount() const;
+		//The pool frames render on, free between frames for loading and building a scene
+		ThreadPool* GetThreadPool() const { return m_pThreadPool.get(); }
 
 	private:
 		enum class LightingMode
@@ -37,12 +80,74 @@ namespace dae
 
 		LightingMode m_currentLightingMode{ LightingMode::Combined };
 
+		//Screen rectangle rendered as one task, predictedCost comes from the previous frame
+		struct Tile
+		{
+			int fromX{};
+			int toX{};
+			int fromY{};
+			int toY{};
+			uint32_t baseTileIndex{};
+			float predictedCost{};
+		};
+
+		static constexpr int m_TileSize{ 64 };
+		static constexpr int m_MinTileSize{ 8 };
+		static constexpr int m_TasksPerThread{ 4 };
+
+		//Measured render time (ns) of every base tile, written concurrently by the tasks covering it
+		std::vector<std::atomic<uint64_t>> m_TileCosts{};
+
 		SDL_Window* m_pWindow{};
+		std::unique_ptr<ThreadPool> m_pThreadPool{};
 
-		SDL_Surface* m_pBuffer{};
+		//Always rendered to in memory, copied to the window surface when presenting
+		std::vector<uint32_t> m_Buffer{};
 		uint32_t* m_pBufferPixels{};
+
+		//Closest hit of the pixel center of every pixel, stored whenever the first sample of an image is traced
+		//Valid until the camera or the geometry changes: new shading (lights, materials, settings) only reshades it
+		struct GBufferPixel
+		{
+			HitRecord closestHit{};
+			Vector3 viewDirection{};
+		};
+		std::vector<GBufferPixel> m_GBuffer{};
+		GBufferPixel* m_pGBufferPixels{};
+		bool m_IsGBufferValid{ false };
+		bool m_IsReshading{ false }; //This frame shades m_GBuffer instead of tracing
+		uint64_t m_GeometryVersion{}; //Scene versions of the current G-buffer and image
+		uint64_t m_ShadingVersion{};
+
+		//Progressive mode, sum of every sample since the last reset (allocated the first time progressive mode is enabled)
+		static constexpr uint32_t m_MaxSampleCount{ 256 }; //Converged, later frames only present
+		std::vector<ColorRGB> m_AccumulationBuffer{};
+		ColorRGB* m_pAccumulationPixels{};
+		bool m_IsProgressive{ false };
+		uint32_t m_SampleCount{}; //Samples in the current image, 0 = traced again next frame
+		//Primary rays of this frame, the sample is the pixel center unless progressive
+		RayGenerator m_RayGenerator{};
+
 		bool m_RenderShadows = true;
+		bool m_UsePacketTracing = true;
 		int m_Width{};
 		int m_Height{};
+
+		void Initialize(uint32_t threadCount);
+		void RestartImage() { m_SampleCount = 0; }
+		std::vector<Tile> CreateTiles() const;
+		void SplitTile(const Tile& tile, float targetCost, std::vector<Tile>& tiles) const;
+		void RenderTile(const Scene* pScene, const Tile& tile);
+
+		void Trace(const Scene* pScene, const RayGenerator& rayGenerator, int fromX, int toX, int fromY, int toY) const;
+		//Shading pass only, shades the G-buffer of a sub-rectangle
+		void Reshade(const Scene* pScene, int fromX, int toX, int fromY, int toY) const;
+		ColorRGB ShadePixel(const Scene* pScene, const HitRecord& closestHit, const Vector3& viewDirection) const;
+		template<typename MaterialParameters>
+		ColorRGB ShadeLights(const Scene* pScene, const HitRecord& closestHit, const Vector3& viewDirection, const MaterialParameters& material) const;
+		//Shades a traced hit, pixel center hits are stored in the G-buffer as well
+		void WriteHit(const Scene* pScene, int px, int py, const HitRecord& closestHit, const Vector3& viewDirection) const;
+		void WritePixel(int px, int py, ColorRGB finalColor) const;
+		void Present() const;
 	};
 }
@@ -1,98 +1,572 @@
 #include "Scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <random>
+
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
+#include "SceneFile.h"
+#include "Statistics.h"
+#include "ThreadPool.h"
 
 namespace dae {
 
+	namespace
+	{
+		//Shared by all scenes, so two scenes never report the same version
+		std::atomic<uint64_t> g_SceneVersion{};
+
+		//Runs func(i) for every i in [0, count), in blocks of blockSize on pThreadPool when given
+		template<typename Func>
+		void ForEach(ThreadPool* pThreadPool, size_t count, size_t blockSize, const Func& func)
+		{
+			ParallelForBlocks(pThreadPool, count, blockSize, [&](size_t first, size_t end)
+				{
+					for (size_t i{ first }; i < end; ++i)
+					{
+						func(i);
+					}
+				});
+		}
+	}
+
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
-	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+	Scene::Scene()
 	{
+		m_Materials.Add(Material_SolidColor{ {1,0,0} });
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
 		m_Lights.reserve(32);
+		MarkGeometryChanged();
+		MarkShadingChanged();
 	}
 
-	Scene::~Scene()
+	Scene::~Scene() = default;
+
+	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
-		for(auto& pMaterial : m_Materials)
+		assert(!m_IsAccelerationStructureDirty && "BuildAccelerationStructure was not called after adding geometry");
+
+		//Traversal only keeps t and the primitive, position/normal/material are resolved once for the closest hit
+		HitCandidate closest{};
+		closest.t = closestHit.t;
+
+		TraceCounters& counters{ Statistics::GetCounters() };
+		++counters.closestHitRays;
+
+		//Check the planes
+		RAYTRACER_STATS_ONLY(counters.primitiveTests += m_Planes.count);
+		const int planeIndex{ GeometryUtils::HitTest_Planes(m_Planes, ray, closest.t) };
+		if (planeIndex != -1)
 		{
-			delete pMaterial;
-			pMaterial = nullptr;
+			closest.type = PrimitiveType::Plane;
+			closest.primitiveIndex = static_cast<uint32_t>(planeIndex);
 		}
 
-		m_Materials.clear();
+		//Check the spheres and triangles, only leaves in front of the closest plane hit are visited
+		m_BVH.Traverse(ray, closest.t, [&](uint32_t first, uint32_t count, float& tMax)
+			{
+				RAYTRACER_STATS_ONLY(counters.primitiveTests += count);
+
+				//The spheres of a leaf are tested as one batch
+				const uint32_t sphereCount{ GetLeafSphereCount(first, count) };
+				if (sphereCount > 0)
+				{
+					const int sphereIndex{ GeometryUtils::HitTest_Spheres(m_Spheres, m_BVHPrimitives[first].index, sphereCount, ray, closest.t) };
+					if (sphereIndex != -1)
+					{
+						closest.type = PrimitiveType::Sphere;
+						closest.primitiveIndex = static_cast<uint32_t>(sphereIndex);
+					}
+				}
+
+				for (uint32_t i{ first + sphereCount }; i < first + count; ++i)
+				{
+					float t{};
+					if (GeometryUtils::HitTest_Triangle(m_PrecomputedTriangles[m_BVHPrimitives[i].index], ray, t) && t < closest.t)
+					{
+						closest.t = t;
+						closest.type = PrimitiveType::Triangle;
+						closest.primitiveIndex = m_BVHPrimitives[i].index;
+					}
+				}
+
+				tMax = closest.t;
+				return false;
+			});
+
+		//Check the meshes
+		GetClosestMeshHit(ray, closest);
+
+		if (closest.t < closestHit.t)
+		{
+			ResolveHit(closest, ray, closestHit);
+		}
 	}
 
-	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
+	void Scene::GetClosestHit(RayPacket& packet, HitRecord* pHitRecords) const
 	{
+		assert(!m_IsAccelerationStructureDirty && "BuildAccelerationStructure was not called after adding geometry");
+
+		const int activeMask{ packet.GetActiveMask() };
+
+		//Every lane counts as a ray, a packet test counts once for every lane it covers
+		const uint64_t laneCount{ static_cast<uint64_t>(std::popcount(static_cast<unsigned int>(activeMask))) };
+		TraceCounters& counters{ Statistics::GetCounters() };
+		counters.closestHitRays += laneCount;
+
+		//Every kernel shrinks packet.tMax of the lanes it hits, only the primitive that did it is remembered
+		HitCandidate closest[SIMD_WIDTH]{};
+		int hitMask{};
+		const auto recordHits = [&](int laneMask, PrimitiveType type, uint32_t primitiveIndex)
+			{
+				hitMask |= laneMask;
+				for (; laneMask != 0; laneMask &= laneMask - 1)
+				{
+					HitCandidate& candidate{ closest[std::countr_zero(static_cast<unsigned int>(laneMask))] };
+					candidate.type = type;
+					candidate.primitiveIndex = primitiveIndex;
+				}
+			};
+
 		//Check the planes
-		const size_t planeGeometriesSize{ m_PlaneGeometries.size() };
-		for (size_t i{}; i < planeGeometriesSize; ++i)
+		RAYTRACER_STATS_ONLY(counters.primitiveTests += laneCount * m_PlaneGeometries.size());
+		for (size_t i{}; i < m_PlaneGeometries.size(); ++i)
 		{
-			HitRecord hitInfo{};
-			GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray, hitInfo);
-			if (hitInfo.t < closestHit.t)
-			{
-				closestHit = hitInfo;
-			}
+			recordHits(GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], packet), PrimitiveType::Plane, static_cast<uint32_t>(i));
 		}
 
-		// Check the spheres
-		const size_t sphereGeometriesSize{ m_SphereGeometries.size() };
-		for (size_t i{}; i < sphereGeometriesSize; ++i)
+		//Check the spheres and triangles
+		m_BVH.TraversePacket(packet, [&](uint32_t first, uint32_t count)
+			{
+				RAYTRACER_STATS_ONLY(counters.primitiveTests += laneCount * count);
+				for (uint32_t i{ first }; i < first + count; ++i)
+				{
+					const PrimitiveRef& primitive{ m_BVHPrimitives[i] };
+					if (primitive.type == PrimitiveType::Sphere)
+						recordHits(GeometryUtils::HitTest_Sphere(m_Spheres.GetSphere(primitive.index), packet), primitive.type, primitive.index);
+					else
+						recordHits(GeometryUtils::HitTest_Triangle(m_PrecomputedTriangles[primitive.index], packet), primitive.type, primitive.index);
+				}
+			});
+
+		for (int lane{}; lane < SIMD_WIDTH; ++lane)
 		{
-			HitRecord hitInfo{};
-			GeometryUtils::HitTest_Sphere(m_SphereGeometries[i], ray, hitInfo);
-			if (hitInfo.t < closestHit.t)
+			if ((activeMask >> lane & 1) == 0)
+				continue;
+
+			const Ray ray{ packet.GetRay(lane) };
+			if (hitMask >> lane & 1)
+				closest[lane].t = ray.max;
+
+			//Meshes fall back to single rays, every lane enters its own instances
+			GetClosestMeshHit(ray, closest[lane]);
+
+			if (closest[lane].t < pHitRecords[lane].t)
+				ResolveHit(closest[lane], ray, pHitRecords[lane]);
+		}
+	}
+
+	void Scene::GetClosestMeshHit(const Ray& ray, HitCandidate& closest) const
+	{
+		//Each instance clips its bottom level traversal to the closest hit so far
+		m_MeshBVH.Traverse(ray, closest.t, [&](uint32_t first, uint32_t count, float& tMax)
 			{
-				closestHit = hitInfo;
-			}
+				for (uint32_t i{ first }; i < first + count; ++i)
+				{
+					const MeshPlacement& placement{ m_MeshPlacements[i] };
+					const TriangleMesh& mesh{ m_TriangleMeshGeometries[placement.meshIndex] };
+					const Matrix& inverseTransform{ placement.instanceIndex == MeshInstance::noInstance
+						? mesh.inverseTransform : m_MeshInstances[placement.instanceIndex].inverseTransform };
+
+					uint32_t triangleIndex{};
+					if (GeometryUtils::HitTest_TriangleMesh(mesh, inverseTransform, ray, closest.t, triangleIndex))
+					{
+						closest.type = PrimitiveType::MeshTriangle;
+						closest.primitiveIndex = triangleIndex;
+						closest.meshIndex = placement.meshIndex;
+						closest.instanceIndex = placement.instanceIndex;
+					}
+				}
+
+				tMax = closest.t;
+				return false;
+			});
+	}
+
+	void Scene::ResolveHit(const HitCandidate& hit, const Ray& ray, HitRecord& hitRecord) const
+	{
+		hitRecord.t = hit.t;
+		hitRecord.didHit = true;
+		hitRecord.origin = ray.origin + hit.t * ray.direction;
+
+		switch (hit.type)
+		{
+		case PrimitiveType::Plane:
+		{
+			const Plane& plane{ m_PlaneGeometries[hit.primitiveIndex] };
+			hitRecord.normal = plane.normal;
+			hitRecord.materialIndex = plane.materialIndex;
+			break;
+		}
+		case PrimitiveType::Sphere:
+		{
+			const Sphere sphere{ m_Spheres.GetSphere(hit.primitiveIndex) };
+			hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+			hitRecord.materialIndex = m_SphereMaterialIndices[hit.primitiveIndex];
+			break;
+		}
+		case PrimitiveType::Triangle:
+		{
+			const Triangle& triangle{ m_Triangles[m_PrecomputedTriangles[hit.primitiveIndex].triangleIndex] };
+			hitRecord.normal = Vector3::Cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0).Normalized();
+			hitRecord.materialIndex = triangle.materialIndex;
+			break;
 		}
-		// Check the triangles
-		const size_t trianglesGeometriesSize{ m_Triangles.size() };
-		for (size_t i{}; i < trianglesGeometriesSize; ++i)
+		case PrimitiveType::MeshTriangle:
 		{
-			HitRecord hitInfo{};
-			GeometryUtils::HitTest_Triangle(m_Triangles[i], ray, hitInfo);
-			if (hitInfo.t < closestHit.t)
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[hit.meshIndex] };
+			if (hit.instanceIndex == MeshInstance::noInstance)
 			{
-				closestHit = hitInfo;
+				hitRecord.normal = mesh.GetWorldNormal(hit.primitiveIndex);
+				hitRecord.materialIndex = mesh.GetMaterialIndex(hit.primitiveIndex);
 			}
+			else
+			{
+				const MeshInstance& instance{ m_MeshInstances[hit.instanceIndex] };
+				hitRecord.normal = instance.GetWorldNormal(mesh, hit.primitiveIndex);
+				hitRecord.materialIndex = instance.GetMaterialIndex(mesh, hit.primitiveIndex);
+			}
+			break;
+		}
 		}
-	
 	}
 
 	bool Scene::DoesHit(const Ray& ray) const
 	{
-		for (int i = 0; i < m_SphereGeometries.size(); ++i)
-		{
-			if (GeometryUtils::HitTest_Sphere(m_SphereGeometries[i], ray))
+		assert(!m_IsAccelerationStructureDirty && "BuildAccelerationStructure was not called after adding geometry");
+
+		TraceCounters& counters{ Statistics::GetCounters() };
+		++counters.anyHitRays;
+
+		bool didHit{ false };
+		m_BVH.Traverse(ray, ray.max, [&](uint32_t first, uint32_t count, float&)
 			{
-				return true;
-			}
+				const uint32_t sphereCount{ GetLeafSphereCount(first, count) };
+				if (sphereCount > 0)
+				{
+					RAYTRACER_STATS_ONLY(counters.primitiveTests += sphereCount);
+					didHit = GeometryUtils::HitTest_Spheres(m_Spheres, m_BVHPrimitives[first].index, sphereCount, ray);
+					if (didHit)
+						return true;
+				}
+
+				for (uint32_t i{ first + sphereCount }; i < first + count; ++i)
+				{
+					RAYTRACER_STATS_ONLY(++counters.primitiveTests);
+					float t{};
+					didHit = GeometryUtils::HitTest_Triangle(m_PrecomputedTriangles[m_BVHPrimitives[i].index], ray, t);
+					if (didHit)
+						return true;
+				}
+				return false;
+			});
+
+		if (didHit)
+			return true;
+
+		m_MeshBVH.Traverse(ray, ray.max, [&](uint32_t first, uint32_t count, float&)
+			{
+				for (uint32_t i{ first }; i < first + count; ++i)
+				{
+					const MeshPlacement& placement{ m_MeshPlacements[i] };
+					const TriangleMesh& mesh{ m_TriangleMeshGeometries[placement.meshIndex] };
+					didHit = GeometryUtils::HitTest_TriangleMesh(mesh, placement.instanceIndex == MeshInstance::noInstance
+						? mesh.inverseTransform : m_MeshInstances[placement.instanceIndex].inverseTransform, ray);
+					if (didHit)
+						return true;
+				}
+				return false;
+			});
+
+		if (didHit)
+			return true;
+
+		RAYTRACER_STATS_ONLY(counters.primitiveTests += m_Planes.count);
+		return GeometryUtils::HitTest_Planes(m_Planes, ray);
+	}
+
+	void Scene::BuildAccelerationStructure(ThreadPool* pThreadPool)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		std::vector<AABB> primitiveBounds{};
+		std::vector<PrimitiveRef> primitives{};
+		primitiveBounds.reserve(m_SphereGeometries.size() + m_Triangles.size());
+		primitives.reserve(m_SphereGeometries.size() + m_Triangles.size());
+
+		for (size_t i{}; i < m_SphereGeometries.size(); ++i)
+		{
+			const Sphere& sphere{ m_SphereGeometries[i] };
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+
+			AABB bounds{};
+			bounds.Grow(sphere.origin - extent);
+			bounds.Grow(sphere.origin + extent);
+			primitiveBounds.emplace_back(bounds);
+			primitives.push_back({ static_cast<uint32_t>(i), PrimitiveType::Sphere });
 		}
-		for (int i = 0; i < m_Triangles.size(); ++i)
+
+		for (size_t i{}; i < m_Triangles.size(); ++i)
+		{
+			const Triangle& triangle{ m_Triangles[i] };
+
+			AABB bounds{};
+			bounds.Grow(triangle.v0);
+			bounds.Grow(triangle.v1);
+			bounds.Grow(triangle.v2);
+			primitiveBounds.emplace_back(bounds);
+			primitives.push_back({ static_cast<uint32_t>(i), PrimitiveType::Triangle });
+		}
+
+		m_BVH.Build(primitiveBounds, pThreadPool);
+
+		//Store the primitives in leaf order, so a leaf range indexes m_BVHPrimitives directly
+		const std::vector<uint32_t>& primitiveIndices{ m_BVH.GetPrimitiveIndices() };
+		m_BVHPrimitives.resize(primitiveIndices.size());
+		for (size_t i{}; i < primitiveIndices.size(); ++i)
 		{
-			if (GeometryUtils::HitTest_Triangle(m_Triangles[i], ray))
+			m_BVHPrimitives[i] = primitives[primitiveIndices[i]];
+		}
+
+		//Spheres go first in every leaf and are copied to m_Spheres in that order,
+		//so the spheres of a leaf are one consecutive range of m_Spheres
+		//Triangles are precomputed in the same order, right behind the spheres they share a leaf with
+		m_Spheres.Clear();
+		m_SphereMaterialIndices.clear();
+		m_PrecomputedTriangles.clear();
+		m_PrecomputedTriangles.reserve(m_Triangles.size());
+		for (const BVHNode& node : m_BVH.GetNodes())
+		{
+			if (!node.IsLeaf())
+				continue;
+
+			const auto leafBegin{ m_BVHPrimitives.begin() + node.leftFirst };
+			const auto leafEnd{ leafBegin + node.primitiveCount };
+			std::stable_partition(leafBegin, leafEnd, [](const PrimitiveRef& primitive) { return primitive.type == PrimitiveType::Sphere; });
+
+			for (auto it{ leafBegin }; it != leafEnd; ++it)
 			{
-				return true;
+				if (it->type == PrimitiveType::Sphere)
+				{
+					m_Spheres.Add(m_SphereGeometries[it->index]);
+					m_SphereMaterialIndices.push_back(m_SphereGeometries[it->index].materialIndex);
+					it->index = static_cast<uint32_t>(m_Spheres.count - 1);
+				}
+				else
+				{
+					m_PrecomputedTriangles.emplace_back(m_Triangles[it->index], it->index);
+					it->index = static_cast<uint32_t>(m_PrecomputedTriangles.size() - 1);
+				}
 			}
 		}
-		for (int i = 0; i < m_PlaneGeometries.size(); ++i)
+
+		m_Planes.Clear();
+		for (const Plane& plane : m_PlaneGeometries)
+		{
+			m_Planes.Add(plane);
+		}
+
+		//Bottom levels are built once in object space (meshes read from a mesh cache come with theirs),
+		//the top level is refitted whenever a mesh or instance moves
+		bool isBottomLevelRebuilt{};
+		UpdateMeshes(pThreadPool, isBottomLevelRebuilt);
+		BuildMeshBVH(pThreadPool);
+
+		AccelerationStructureStats& stats{ m_AccelerationStructureStats };
+		stats.lastBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		stats.nodeCount = m_BVH.GetNodes().size() + m_MeshBVH.GetNodes().size();
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			stats.nodeCount += mesh.bvh.GetNodes().size();
+		}
+
+		m_IsAccelerationStructureDirty = false;
+	}
+
+	void Scene::UpdateAccelerationStructure(ThreadPool* pThreadPool)
+	{
+		if (m_IsAccelerationStructureDirty)
+		{
+			BuildAccelerationStructure(pThreadPool);
+			return;
+		}
+
+		bool isBottomLevelRebuilt{};
+		if (!UpdateMeshes(pThreadPool, isBottomLevelRebuilt))
+			return;
+
+		//A rebuilt mesh can have become empty (or no longer be), the top level leaves change then
+		if (isBottomLevelRebuilt)
+			BuildMeshBVH(pThreadPool);
+		else
+			RefitMeshBVH(pThreadPool);
+		MarkGeometryChanged();
+	}
+
+	void Scene::MarkGeometryChanged()
+	{
+		m_GeometryVersion = ++g_SceneVersion;
+	}
+
+	void Scene::MarkShadingChanged()
+	{
+		m_ShadingVersion = ++g_SceneVersion;
+	}
+
+	uint32_t Scene::GetLeafSphereCount(uint32_t first, uint32_t count) const
+	{
+		uint32_t sphereCount{};
+		while (sphereCount < count && m_BVHPrimitives[first + sphereCount].type == PrimitiveType::Sphere)
+		{
+			++sphereCount;
+		}
+		return sphereCount;
+	}
+
+	bool Scene::UpdateMeshes(ThreadPool* pThreadPool, bool& isBottomLevelRebuilt)
+	{
+		//Find what changed first, the updates themselves are independent and run in parallel
+		bool hasMeshChanged{ false };
+		std::vector<uint8_t> isBVHRebuilt(m_TriangleMeshGeometries.size());
+		for (size_t i{}; i < m_TriangleMeshGeometries.size(); ++i)
 		{
-			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[i], ray))
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+			isBVHRebuilt[i] = mesh.isBVHDirty;
+			isBottomLevelRebuilt |= mesh.isBVHDirty;
+			hasMeshChanged |= mesh.isBVHDirty || mesh.isTransformDirty;
+		}
+
+		//Big meshes are built one after the other with every thread, the rest one mesh per task
+		//(a build inside a task would run on that one thread, see ThreadPool)
+		for (TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (mesh.isBVHDirty && mesh.indices.size() / 3 > BVH::parallelBuildSize)
+				mesh.BuildBVH(pThreadPool);
+		}
+
+		//Only does work for the meshes that moved or were rebuilt
+		ForEach(pThreadPool, m_TriangleMeshGeometries.size(), 1, [&](size_t i)
 			{
-				return true;
-			}
+				TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+				if (mesh.isBVHDirty)
+					mesh.BuildBVH();
+				mesh.UpdateTransforms();
+			});
+
+		//The world bounds of an instance follow the bounds of its mesh as well
+		for (const MeshInstance& instance : m_MeshInstances)
+		{
+			hasMeshChanged |= instance.isTransformDirty || isBVHRebuilt[instance.meshIndex];
 		}
-		return false;
+		ForEach(pThreadPool, m_MeshInstances.size(), 1024, [&](size_t i)
+			{
+				MeshInstance& instance{ m_MeshInstances[i] };
+				if (instance.isTransformDirty || isBVHRebuilt[instance.meshIndex])
+					instance.UpdateTransform(m_TriangleMeshGeometries[instance.meshIndex]);
+			});
+		return hasMeshChanged;
+	}
+
+	void Scene::BuildMeshBVH(ThreadPool* pThreadPool)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		std::vector<AABB> placementBounds{};
+		std::vector<MeshPlacement> placements{};
+		placementBounds.reserve(m_TriangleMeshGeometries.size() + m_MeshInstances.size());
+		placements.reserve(m_TriangleMeshGeometries.size() + m_MeshInstances.size());
+
+		//Meshes with instances are only placed through them
+		std::vector<bool> isInstanced(m_TriangleMeshGeometries.size());
+		for (size_t i{}; i < m_MeshInstances.size(); ++i)
+		{
+			const MeshInstance& instance{ m_MeshInstances[i] };
+			isInstanced[instance.meshIndex] = true;
+
+			//Empty meshes have no bounds and are left out
+			if (m_TriangleMeshGeometries[instance.meshIndex].bvh.IsEmpty())
+				continue;
+
+			placements.push_back({ instance.meshIndex, static_cast<uint32_t>(i) });
+			placementBounds.emplace_back(GetPlacementBounds(placements.back()));
+		}
+
+		for (size_t i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			if (isInstanced[i] || m_TriangleMeshGeometries[i].bvh.IsEmpty())
+				continue;
+
+			placements.push_back({ static_cast<uint32_t>(i), MeshInstance::noInstance });
+			placementBounds.emplace_back(GetPlacementBounds(placements.back()));
+		}
+
+		m_MeshBVH.Build(placementBounds, pThreadPool);
+
+		const std::vector<uint32_t>& leafOrder{ m_MeshBVH.GetPrimitiveIndices() };
+		m_MeshPlacements.resize(leafOrder.size());
+		for (size_t i{}; i < leafOrder.size(); ++i)
+		{
+			m_MeshPlacements[i] = placements[leafOrder[i]];
+		}
+		m_MeshBVHBuildCost = m_MeshBVH.GetCost();
+
+		AccelerationStructureStats& stats{ m_AccelerationStructureStats };
+		stats.lastRebuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		stats.totalRebuildMs += stats.lastRebuildMs;
+		++stats.rebuildCount;
+		stats.costRatio = 1.f;
+	}
+
+	void Scene::RefitMeshBVH(ThreadPool* pThreadPool)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		//Refit wants the bounds in build order, the placements are stored in leaf order
+		const std::vector<uint32_t>& leafOrder{ m_MeshBVH.GetPrimitiveIndices() };
+		std::vector<AABB> placementBounds(m_MeshPlacements.size());
+		for (size_t i{}; i < m_MeshPlacements.size(); ++i)
+		{
+			placementBounds[leafOrder[i]] = GetPlacementBounds(m_MeshPlacements[i]);
+		}
+		m_MeshBVH.Refit(placementBounds, pThreadPool);
+
+		//Moving primitives grow the nodes and make them overlap, rays then visit more of them
+		AccelerationStructureStats& stats{ m_AccelerationStructureStats };
+		stats.costRatio = m_MeshBVHBuildCost > 0.f ? m_MeshBVH.GetCost() / m_MeshBVHBuildCost : 1.f;
+		stats.lastRefitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		stats.totalRefitMs += stats.lastRefitMs;
+		++stats.refitCount;
+
+		if (stats.costRatio > m_MaxMeshBVHCostRatio)
+			BuildMeshBVH(pThreadPool);
+	}
+
+	const AABB& Scene::GetPlacementBounds(const MeshPlacement& placement) const
+	{
+		if (placement.instanceIndex == MeshInstance::noInstance)
+			return m_TriangleMeshGeometries[placement.meshIndex].GetWorldBounds();
+		return m_MeshInstances[placement.instanceIndex].worldBounds;
 	}
 
 #pragma region Scene Helpers
-	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
+	Sphere* Scene::AddSphere(const Vector3& origin, float radius, uint32_t materialIndex)
 	{
 		Sphere s;
 		s.origin = origin;
@@ -100,10 +574,12 @@ namespace dae {
 		s.materialIndex = materialIndex;
 
 		m_SphereGeometries.emplace_back(s);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
 		return &m_SphereGeometries.back();
 	}
 
-	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex)
+	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, uint32_t materialIndex)
 	{
 		Plane p;
 		p.origin = origin;
@@ -111,19 +587,67 @@ namespace dae {
 		p.materialIndex = materialIndex;
 
 		m_PlaneGeometries.emplace_back(p);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
 		return &m_PlaneGeometries.back();
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	Triangle* Scene::AddTriangle(const Triangle& triangle)
+	{
+		m_Triangles.emplace_back(triangle);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+		return &m_Triangles.back();
+	}
+
+	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, uint32_t materialIndex)
 	{
 		TriangleMesh m{};
 		m.cullMode = cullMode;
 		m.materialIndex = materialIndex;
 
 		m_TriangleMeshGeometries.emplace_back(m);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	TriangleMesh* Scene::AddTriangleMesh(const std::string& objPath, TriangleCullMode cullMode, uint32_t materialIndex, ThreadPool* pThreadPool,
+		std::string* pError)
+	{
+		TriangleMesh m{};
+		m.cullMode = cullMode;
+		m.materialIndex = materialIndex;
+		MeshCache::LoadStats stats{};
+		if (!MeshCache::LoadOBJ(objPath, m, {}, pThreadPool, &stats))
+		{
+			if (pError)
+				*pError = stats.error;
+			return nullptr;
+		}
+
+		m_TriangleMeshGeometries.emplace_back(std::move(m));
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+		return &m_TriangleMeshGeometries.back();
+	}
+
+	MeshInstance* Scene::AddMeshInstance(const TriangleMesh* pMesh, const Matrix& transform, uint32_t materialIndex)
+	{
+		assert(pMesh >= m_TriangleMeshGeometries.data() && pMesh < m_TriangleMeshGeometries.data() + m_TriangleMeshGeometries.size()
+			&& "pMesh is not a mesh of this scene");
+
+		MeshInstance instance{};
+		instance.meshIndex = static_cast<uint32_t>(pMesh - m_TriangleMeshGeometries.data());
+		instance.materialIndex = materialIndex;
+		instance.SetTransform(transform);
+
+		m_MeshInstances.emplace_back(instance);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+		return &m_MeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -133,6 +657,7 @@ namespace dae {
 		l.type = LightType::Point;
 
 		m_Lights.emplace_back(l);
+		MarkShadingChanged();
 		return &m_Lights.back();
 	}
 
@@ -145,13 +670,47 @@ namespace dae {
 		l.type = LightType::Directional;
 
 		m_Lights.emplace_back(l);
+		MarkShadingChanged();
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	void Scene::AddSpheres(const Sphere* pSpheres, size_t count)
+	{
+		if (count == 0)
+			return;
+
+		m_SphereGeometries.insert(m_SphereGeometries.end(), pSpheres, pSpheres + count);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+	}
+
+	void Scene::AddPlanes(const Plane* pPlanes, size_t count)
 	{
-		m_Materials.push_back(pMaterial);
-		return static_cast<unsigned char>(m_Materials.size() - 1);
+		if (count == 0)
+			return;
+
+		m_PlaneGeometries.insert(m_PlaneGeometries.end(), pPlanes, pPlanes + count);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+	}
+
+	void Scene::AddTriangles(const Triangle* pTriangles, size_t count)
+	{
+		if (count == 0)
+			return;
+
+		m_Triangles.insert(m_Triangles.end(), pTriangles, pTriangles + count);
+		m_IsAccelerationStructureDirty = true;
+		MarkGeometryChanged();
+	}
+
+	void Scene::AddLights(const Light* pLights, size_t count)
+	{
+		if (count == 0)
+			return;
+
+		m_Lights.insert(m_Lights.end(), pLights, pLights + count);
+		MarkShadingChanged();
 	}
 #pragma endregion
 #pragma endregion
@@ -160,11 +719,11 @@ namespace dae {
 	void Scene_W1::Initialize()
 	{
 		//default: Material id0 >> SolidColor Material (RED)
-		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		constexpr uint32_t matId_Solid_Red = 0;
+		const uint32_t matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
+		const uint32_t matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const uint32_t matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const uint32_t matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -183,11 +742,11 @@ namespace dae {
 		m_Camera.origin = { 0.f ,3.f , -9.f };
 		m_Camera.fovAngle = 45.f;
 		// default : Material id0 >> SolidColor Material ( RED )
-		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		constexpr uint32_t matId_Solid_Red = 0;
+		const uint32_t matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
+		const uint32_t matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const uint32_t matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const uint32_t matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 		// Plane
 		AddPlane({ -5.f ,0.f ,0.f }, { 1.f , 0.f , 0.f }, matId_Solid_Green);
 		AddPlane({ 5.f , 0.f , 0.f }, { -1.f , 0.f , 0.f }, matId_Solid_Green);
@@ -215,14 +774,14 @@ namespace dae {
 		const ColorRGB ballPlasticColor = ColorRGB{ .75f, .75f, .75f };
 		const ColorRGB ballMetalColor = ColorRGB{ .972f, .960f, .915f };
 
-		const auto matWhiteRoughPlastic = AddMaterial(new Material_CookTorrence(ballPlasticColor, 0.f, 1.f));
-		const auto matWhiteMediumPlastic = AddMaterial(new Material_CookTorrence(ballPlasticColor, 0.f, .6f));
-		const auto matWhiteSmoothPlastic = AddMaterial(new Material_CookTorrence(ballPlasticColor, 0.f, .1f));
-		const auto matSilverRoughMetal = AddMaterial(new Material_CookTorrence(ballMetalColor, 1.f, 1.f));
-		const auto matSilverMediumMetal = AddMaterial(new Material_CookTorrence(ballMetalColor, 1.f, .6f));
-		const auto matSilverSmoothMetal = AddMaterial(new Material_CookTorrence(ballMetalColor, 1.f, .1f));
+		const auto matWhiteRoughPlastic = AddMaterial(Material_CookTorrence{ ballPlasticColor, 0.f, 1.f });
+		const auto matWhiteMediumPlastic = AddMaterial(Material_CookTorrence{ ballPlasticColor, 0.f, .6f });
+		const auto matWhiteSmoothPlastic = AddMaterial(Material_CookTorrence{ ballPlasticColor, 0.f, .1f });
+		const auto matSilverRoughMetal = AddMaterial(Material_CookTorrence{ ballMetalColor, 1.f, 1.f });
+		const auto matSilverMediumMetal = AddMaterial(Material_CookTorrence{ ballMetalColor, 1.f, .6f });
+		const auto matSilverSmoothMetal = AddMaterial(Material_CookTorrence{ ballMetalColor, 1.f, .1f });
 
-		const auto matWall = AddMaterial(new Material_Lambert(wallColor, 1.f));
+		const auto matWall = AddMaterial(Material_Lambert{ wallColor, 1.f });
 
 		//Spheres
 		AddSphere({ -1.75f, 3.f, .0f }, .75f, matWhiteRoughPlastic);
@@ -249,8 +808,8 @@ namespace dae {
 		m_Camera.origin = { 0.f ,1.f , -5.f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f, 0.57f, 0.57f }, 1.0f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.0f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert{ { .49f, 0.57f, 0.57f }, 1.0f });
+		const auto matLambert_White = AddMaterial(Material_Lambert{ colors::White, 1.0f });
 
 		//Planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f,0.f,-1.f }, matLambert_GrayBlue); //BACK
@@ -264,7 +823,7 @@ namespace dae {
 		triangle.cullMode = TriangleCullMode::NoCulling;
 		triangle.materialIndex = matLambert_White;
 
-		m_Triangles.emplace_back(triangle);
+		AddTriangle(triangle);
 
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f,5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //BACKLIGHT
@@ -272,4 +831,296 @@ namespace dae {
 		AddPointLight(Vector3{ 2.5f,2.5f,-5.f }, 50.f, ColorRGB{ .34f, .47f, .68f }); //FRONT LIGHT RIGHT    }
 	}
 #pragma endregion
+
+#pragma region SCENE BVH BENCHMARK
+	void Scene_BVHBenchmark::Initialize()
+	{
+		m_Camera.origin = { 0.f, 0.f, -100.f };
+		m_Camera.fovAngle = 60.f;
+
+		const auto matLambert_White = AddMaterial(Material_Lambert{ colors::White, 1.f });
+
+		//Fixed seed, every run benchmarks the same scene
+		std::mt19937 generator{ 1337 };
+		std::uniform_real_distribution<float> position{ -50.f, 50.f };
+		std::uniform_real_distribution<float> offset{ -1.f, 1.f };
+
+		//Keep the total volume roughly constant, so bigger scenes have smaller primitives
+		const float size{ 20.f / std::cbrt(static_cast<float>(std::max<size_t>(m_PrimitiveCount, 1))) };
+
+		std::vector<Sphere> spheres{};
+		std::vector<Triangle> triangles{};
+		spheres.reserve(m_PrimitiveCount - m_PrimitiveCount / 2);
+		triangles.reserve(m_PrimitiveCount / 2);
+		for (size_t i{}; i < m_PrimitiveCount; ++i)
+		{
+			const Vector3 center{ position(generator), position(generator), position(generator) };
+			if (i % 2 == 0)
+			{
+				spheres.push_back({ center, size * .5f, matLambert_White });
+			}
+			else
+			{
+				auto triangle = Triangle{
+					center + size * Vector3{ offset(generator), offset(generator), offset(generator) },
+					center + size * Vector3{ offset(generator), offset(generator), offset(generator) },
+					center + size * Vector3{ offset(generator), offset(generator), offset(generator) } };
+				triangle.cullMode = TriangleCullMode::NoCulling;
+				triangle.materialIndex = matLambert_White;
+				triangles.emplace_back(triangle);
+			}
+		}
+		AddSpheres(spheres.data(), spheres.size());
+		AddTriangles(triangles.data(), triangles.size());
+
+		AddPointLight({ 0.f, 100.f, -100.f }, 1000.f, colors::White);
+	}
+#pragma endregion
+
+#pragma region STRESS SCENES
+	void Scene_SphereGrid::Initialize()
+	{
+		m_Camera.origin = { 0.f, 4.f, -30.f };
+		m_Camera.fovAngle = 60.f;
+
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert{ { .49f, .57f, .57f }, 1.f });
+		const uint32_t sphereMaterials[]{
+			AddMaterial(Material_Lambert{ { .9f, .3f, .2f }, 1.f }),
+			AddMaterial(Material_CookTorrence{ { .75f, .75f, .75f }, 0.f, .4f }),
+			AddMaterial(Material_CookTorrence{ { .972f, .960f, .915f }, 1.f, .2f }),
+			AddMaterial(Material_LambertPhong{ { .2f, .4f, .9f }, 1.f, .5f, 40.f }) };
+
+		//The grid fills a 20x20x20 cube, the spheres never touch
+		const int spheresPerAxis{ std::max(m_SpheresPerAxis, 1) };
+		const float spacing{ 20.f / spheresPerAxis };
+		const float radius{ spacing * .35f };
+
+		std::vector<Sphere> spheres{};
+		spheres.reserve(static_cast<size_t>(spheresPerAxis) * spheresPerAxis * spheresPerAxis);
+		for (int z{}; z < spheresPerAxis; ++z)
+		{
+			for (int y{}; y < spheresPerAxis; ++y)
+			{
+				for (int x{}; x < spheresPerAxis; ++x)
+				{
+					const Vector3 center{ -10.f + (x + .5f) * spacing, (y + .5f) * spacing - 6.f, (z + .5f) * spacing };
+					spheres.push_back({ center, radius, sphereMaterials[(x + y + z) % std::size(sphereMaterials)] });
+				}
+			}
+		}
+		AddSpheres(spheres.data(), spheres.size());
+
+		AddPlane({ 0.f, -6.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
+
+		AddPointLight({ 0.f, 30.f, -10.f }, 3000.f, ColorRGB{ 1.f, .61f, .45f });
+		AddPointLight({ -20.f, 10.f, -20.f }, 2000.f, ColorRGB{ 1.f, .8f, .45f });
+		AddPointLight({ 20.f, 5.f, -20.f }, 1500.f, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_TriangleSoup::Initialize()
+	{
+		m_Camera.origin = { 0.f, 0.f, -30.f };
+		m_Camera.fovAngle = 60.f;
+
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert{ { .49f, .57f, .57f }, 1.f });
+		const auto matLambert_White = AddMaterial(Material_Lambert{ colors::White, 1.f });
+
+		//Fixed seed, every run benchmarks the same soup
+		std::mt19937 generator{ 1337 };
+		std::uniform_real_distribution<float> position{ -10.f, 10.f };
+		std::uniform_real_distribution<float> offset{ -1.f, 1.f };
+
+		//Keep the covered volume roughly constant, so bigger soups have smaller triangles
+		const float size{ 40.f / std::cbrt(static_cast<float>(std::max<size_t>(m_TriangleCount, 1))) };
+
+		TriangleMesh* pMesh{ AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White) };
+		pMesh->positions.reserve(3 * m_TriangleCount);
+		pMesh->indices.reserve(3 * m_TriangleCount);
+		pMesh->normals.reserve(m_TriangleCount);
+		for (size_t i{}; i < m_TriangleCount; ++i)
+		{
+			const Vector3 center{ position(generator), position(generator), position(generator) };
+			const Triangle triangle{
+				center + size * Vector3{ offset(generator), offset(generator), offset(generator) },
+				center + size * Vector3{ offset(generator), offset(generator), offset(generator) },
+				center + size * Vector3{ offset(generator), offset(generator), offset(generator) } };
+			pMesh->AppendTriangle(triangle);
+		}
+
+		AddPlane({ 0.f, -12.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
+
+		AddPointLight({ 0.f, 30.f, -20.f }, 5000.f, colors::White);
+		AddPointLight({ -20.f, 0.f, -10.f }, 1500.f, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_ManyLights::Initialize()
+	{
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		const ColorRGB wallColor{ .49f, .57f, .57f };
+		const ColorRGB ballPlasticColor{ .75f, .75f, .75f };
+		const ColorRGB ballMetalColor{ .972f, .960f, .915f };
+
+		const auto matWhiteRoughPlastic = AddMaterial(Material_CookTorrence{ ballPlasticColor, 0.f, 1.f });
+		const auto matWhiteSmoothPlastic = AddMaterial(Material_CookTorrence{ ballPlasticColor, 0.f, .1f });
+		const auto matSilverRoughMetal = AddMaterial(Material_CookTorrence{ ballMetalColor, 1.f, 1.f });
+		const auto matSilverSmoothMetal = AddMaterial(Material_CookTorrence{ ballMetalColor, 1.f, .1f });
+		const auto matWall = AddMaterial(Material_Lambert{ wallColor, 1.f });
+
+		//Spheres
+		AddSphere({ -1.75f, 3.f, 0.f }, .75f, matWhiteRoughPlastic);
+		AddSphere({ 0.f, 3.f, 0.f }, .75f, matSilverSmoothMetal);
+		AddSphere({ 1.75f, 3.f, 0.f }, .75f, matWhiteSmoothPlastic);
+		AddSphere({ -1.75f, 1.f, 0.f }, .75f, matSilverRoughMetal);
+		AddSphere({ 0.f, 1.f, 0.f }, .75f, matWhiteSmoothPlastic);
+		AddSphere({ 1.75f, 1.f, 0.f }, .75f, matSilverSmoothMetal);
+
+		//Room
+		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f, -1.f }, matWall);
+		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matWall);
+		AddPlane({ 0.f, 10.f, 0.f }, { 0.f, -1.f, 0.f }, matWall);
+		AddPlane({ 5.f, 0.f, 0.f }, { -1.f, 0.f, 0.f }, matWall);
+		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, matWall);
+
+		//Lights on a golden angle spiral under the ceiling, the total intensity does not depend on the light count
+		const int lightCount{ std::max(m_LightCount, 1) };
+		const float intensity{ 200.f / lightCount };
+		const ColorRGB lightColors[]{ { 1.f, .61f, .45f }, { 1.f, .8f, .45f }, { .34f, .47f, .68f } };
+		for (int i{}; i < lightCount; ++i)
+		{
+			const float radius{ 4.5f * std::sqrt((i + .5f) / lightCount) };
+			const float angle{ i * 2.39996323f };
+			AddPointLight({ radius * std::cos(angle), 8.f, 2.f + radius * std::sin(angle) }, intensity, lightColors[i % std::size(lightColors)]);
+		}
+	}
+
+	void Scene_MeshInstances::Initialize()
+	{
+		const float spacing{ 3.f };
+		const float fieldSize{ spacing * m_InstancesPerAxis };
+
+		m_Camera.origin = { 0.f, 6.f, -12.f };
+		m_Camera.fovAngle = 60.f;
+
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert{ { .49f, .57f, .57f }, 1.f });
+		const auto matLambert_Sand = AddMaterial(Material_Lambert{ { .76f, .70f, .50f }, 1.f });
+		const auto matCookTorrance_Rough = AddMaterial(Material_CookTorrence{ { .75f, .75f, .75f }, 0.f, 1.f });
+		const auto matCookTorrance_Metal = AddMaterial(Material_CookTorrence{ { .972f, .960f, .915f }, 1.f, .3f });
+		const auto matLambertPhong_Rust = AddMaterial(Material_LambertPhong{ { .55f, .25f, .12f }, 1.f, .5f, 20.f });
+
+		//Fixed seed, every run benchmarks the same field
+		std::mt19937 generator{ 2023 };
+		std::uniform_real_distribution<float> jitter{ -.15f, .15f };
+		std::uniform_real_distribution<float> angle{ 0.f, 2.f * PI };
+		std::uniform_real_distribution<float> scale{ .6f, 1.2f };
+
+		//One jittered UV sphere: a pole, ringCount - 1 rings of segmentCount vertices and another pole
+		constexpr int ringCount{ 16 };
+		constexpr int segmentCount{ 32 };
+		TriangleMesh* pRock{ AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_Sand) };
+		pRock->positions.reserve(2 + (ringCount - 1) * segmentCount);
+		pRock->positions.emplace_back(0.f, 1.f + jitter(generator), 0.f);
+		for (int ring{ 1 }; ring < ringCount; ++ring)
+		{
+			const float theta{ PI * ring / ringCount };
+			for (int segment{}; segment < segmentCount; ++segment)
+			{
+				const float phi{ 2.f * PI * segment / segmentCount };
+				const float radius{ 1.f + jitter(generator) };
+				pRock->positions.emplace_back(radius * sinf(theta) * cosf(phi), radius * cosf(theta), radius * sinf(theta) * sinf(phi));
+			}
+		}
+		pRock->positions.emplace_back(0.f, -1.f + jitter(generator), 0.f);
+
+		//Counter clockwise seen from outside, so the face normals point out
+		const auto getRingVertex = [](int ring, int segment) { return 1 + (ring - 1) * segmentCount + segment % segmentCount; };
+		const int bottomPole{ static_cast<int>(pRock->positions.size()) - 1 };
+		for (int segment{}; segment < segmentCount; ++segment)
+		{
+			pRock->indices.insert(pRock->indices.end(), { 0, getRingVertex(1, segment + 1), getRingVertex(1, segment) });
+			for (int ring{ 1 }; ring < ringCount - 1; ++ring)
+			{
+				const int upper{ getRingVertex(ring, segment) };
+				const int upperNext{ getRingVertex(ring, segment + 1) };
+				const int lower{ getRingVertex(ring + 1, segment) };
+				const int lowerNext{ getRingVertex(ring + 1, segment + 1) };
+				pRock->indices.insert(pRock->indices.end(), { upper, upperNext, lowerNext, upper, lowerNext, lower });
+			}
+			pRock->indices.insert(pRock->indices.end(), { getRingVertex(ringCount - 1, segment), getRingVertex(ringCount - 1, segment + 1), bottomPole });
+		}
+		pRock->CalculateNormals();
+
+		//Every fifth rock keeps the material of the mesh
+		const uint32_t materials[]{ MeshInstance::noMaterialOverride, matLambert_GrayBlue, matCookTorrance_Rough, matCookTorrance_Metal, matLambertPhong_Rust };
+		//Own generator, so the layout does not depend on the animation
+		std::mt19937 speedGenerator{ 7 };
+		std::uniform_real_distribution<float> speed{ -1.f, 1.f };
+		m_Rocks.reserve(static_cast<size_t>(m_InstancesPerAxis) * m_InstancesPerAxis);
+		for (int z{}; z < m_InstancesPerAxis; ++z)
+		{
+			for (int x{}; x < m_InstancesPerAxis; ++x)
+			{
+				Rock rock{};
+				rock.scale = scale(generator);
+				rock.position = { spacing * x - .5f * fieldSize, .5f * rock.scale, spacing * z };
+				rock.yaw = angle(generator);
+				rock.speed = speed(speedGenerator);
+				m_Rocks.emplace_back(rock);
+
+				const Matrix transform{ Matrix::CreateScale(rock.scale, .7f * rock.scale, rock.scale)
+					* Matrix::CreateRotationY(rock.yaw)
+					* Matrix::CreateTranslation(rock.position) };
+				AddMeshInstance(pRock, transform, materials[(x + 3 * z) % std::size(materials)]);
+			}
+		}
+
+		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f }, matLambert_GrayBlue);
+
+		AddPointLight({ -10.f, 30.f, -20.f }, 3000.f, colors::White);
+		AddPointLight({ 0.f, 30.f, .5f * fieldSize }, .5f * fieldSize * fieldSize, ColorRGB{ .34f, .47f, .68f });
+	}
+
+	void Scene_MeshInstances::Update(dae::Timer* pTimer)
+	{
+		Scene::Update(pTimer);
+		Animate(pTimer->GetTotal());
+	}
+
+	void Scene_MeshInstances::Animate(float time)
+	{
+		//Every rock runs a circle through its grid position, the circles overlap the neighbouring rocks
+		const float radius{ 1.5f };
+		for (size_t i{}; i < m_Rocks.size(); ++i)
+		{
+			const Rock& rock{ m_Rocks[i] };
+			const float circleAngle{ rock.speed * time };
+			const Vector3 offset{ radius * (cosf(circleAngle) - 1.f), 0.f, radius * sinf(circleAngle) };
+			m_MeshInstances[i].SetTransform(Matrix::CreateScale(rock.scale, .7f * rock.scale, rock.scale)
+				* Matrix::CreateRotationY(rock.yaw + circleAngle)
+				* Matrix::CreateTranslation(rock.position + offset));
+		}
+	}
+#pragma endregion
+
+#pragma region Scene Factory
+	Scene* CreateScene(const std::string& name, ThreadPool* pThreadPool)
+	{
+		if (name.ends_with(".scene")) return new Scene_File(name, pThreadPool);
+		if (name == "W1") return new Scene_W1();
+		if (name == "W2") return new Scene_W2();
+		if (name == "W3") return new Scene_W3();
+		if (name == "W4") return new Scene_W4();
+		if (name == "SphereGrid") return new Scene_SphereGrid(16);
+		if (name == "TriangleSoup") return new Scene_TriangleSoup(100'000);
+		if (name == "ManyLights") return new Scene_ManyLights(32);
+		if (name == "MeshInstances") return new Scene_MeshInstances(64);
+		return nullptr;
+	}
+
+	std::vector<std::string> GetSceneNames()
+	{
+		return { "W1", "W2", "W3", "W4", "SphereGrid", "TriangleSoup", "ManyLights", "MeshInstances" };
+	}
+#pragma endregion
 }
@@ -5,16 +5,34 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "BVH.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
+	class ThreadPool;
 	struct Plane;
 	struct Sphere;
 	struct Light;
 
+	//Upkeep of the top level BVH over the meshes: moved meshes only refit it, until it got too slow to trace
+	struct AccelerationStructureStats
+	{
+		uint64_t refitCount{};
+		uint64_t rebuildCount{}; //Every build, the first one included
+		double lastRefitMs{};
+		double lastRebuildMs{};
+		double totalRefitMs{};
+		double totalRebuildMs{};
+		float costRatio{ 1.f }; //SAH cost now, relative to right after the last rebuild
+
+		//Of the last BuildAccelerationStructure, every level: the primitive BVH, the mesh BVHs and the top level
+		double lastBuildMs{};
+		size_t nodeCount{};
+	};
+
 	//Scene Base Class
 	class Scene
 	{
@@ -34,13 +52,32 @@ namespace dae
 		}
 
 		Camera& GetCamera() { return m_Camera; }
+		const Camera& GetCamera() const { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//Packet version, fills one HitRecord per active lane (pHitRecords holds SIMD_WIDTH records)
+		void GetClosestHit(RayPacket& packet, HitRecord* pHitRecords) const;
 		bool DoesHit(const Ray& ray) const;
 
+		//Rebuilds the BVH over all spheres and triangles and both levels of the mesh hierarchy, call after Initialize
+		//Meshes are built in parallel on pThreadPool when given
+		void BuildAccelerationStructure(ThreadPool* pThreadPool = nullptr);
+		//Cheap per frame update: only rebuilds what changed. Moved meshes and instances refit the top level,
+		//it is only rebuilt once refitting made it too slow (see GetAccelerationStructureStats)
+		void UpdateAccelerationStructure(ThreadPool* pThreadPool = nullptr);
+		const AccelerationStructureStats& GetAccelerationStructureStats() const { return m_AccelerationStructureStats; }
+
+		//Versions change with every edit and are unique over all scenes, the renderer does not trace a frame when
+		//no version and not the camera changed. Geometry changes retrace, light and material changes only reshade
+		uint64_t GetGeometryVersion() const { return m_GeometryVersion; }
+		uint64_t GetShadingVersion() const { return m_ShadingVersion; }
+		//Call after editing the scene directly (e.g. through a pointer returned by an Add function)
+		void MarkGeometryChanged();
+		void MarkShadingChanged();
+
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const MaterialTable& GetMaterials() const { return m_Materials; }
 
 	protected:
 		std::string	sceneName;
@@ -48,19 +85,113 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<MeshInstance> m_MeshInstances{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		MaterialTable m_Materials{};
 		std::vector<Triangle> m_Triangles{};
 
 		Camera m_Camera{};
 
-		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
-		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		Sphere* AddSphere(const Vector3& origin, float radius, uint32_t materialIndex = 0);
+		Plane* AddPlane(const Vector3& origin, const Vector3& normal, uint32_t materialIndex = 0);
+		Triangle* AddTriangle(const Triangle& triangle);
+		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, uint32_t materialIndex = 0);
+		//Loads an OBJ file through the mesh cache next to it (see MeshCache::LoadOBJ), nullptr when it can not be loaded
+		//A cache miss parses and builds on pThreadPool when given, pError optionally receives why a load failed
+		TriangleMesh* AddTriangleMesh(const std::string& objPath, TriangleCullMode cullMode, uint32_t materialIndex = 0, ThreadPool* pThreadPool = nullptr,
+			std::string* pError = nullptr);
+		/**
+		 * \brief Places a mesh once more without copying its geometry, a mesh with instances is only drawn through them
+		 * \param pMesh mesh returned by AddTriangleMesh, its own transform is then ignored
+		 * \param transform object to world transform of this placement
+		 * \param materialIndex material of every face, MeshInstance::noMaterialOverride keeps the materials of the mesh
+		 * \return the instance, call MarkGeometryChanged after changing it (or use SetTransform, then UpdateAccelerationStructure)
+		 */
+		MeshInstance* AddMeshInstance(const TriangleMesh* pMesh, const Matrix& transform, uint32_t materialIndex = MeshInstance::noMaterialOverride);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+
+		//Bulk versions of the Add functions, the whole array is copied in one insert and the scene is marked changed once
+		void AddSpheres(const Sphere* pSpheres, size_t count);
+		void AddPlanes(const Plane* pPlanes, size_t count);
+		void AddTriangles(const Triangle* pTriangles, size_t count);
+		void AddLights(const Light* pLights, size_t count);
+		//material is one of the Material_ parameter blocks, e.g. AddMaterial(Material_Lambert{ colors::White, 1.f })
+		template<typename MaterialParameters>
+		uint32_t AddMaterial(const MaterialParameters& material)
+		{
+			const uint32_t materialIndex{ m_Materials.Add(material) };
+			MarkShadingChanged();
+			return materialIndex;
+		}
+		//Changes the parameters (not the type) of a material added before, e.g. to animate it
+		template<typename MaterialParameters>
+		void SetMaterial(uint32_t materialIndex, const MaterialParameters& material)
+		{
+			m_Materials.Set(materialIndex, material);
+			MarkShadingChanged();
+		}
+		//TriangleMesh::SetFaceMaterial on a mesh of this scene. The G-buffer keeps the material index of every hit,
+		//so the next frame traces again instead of only reshading
+		void SetFaceMaterial(TriangleMesh* pMesh, size_t faceIndex, uint32_t materialIndex)
+		{
+			pMesh->SetFaceMaterial(faceIndex, materialIndex);
+			MarkGeometryChanged();
+		}
+
+	private:
+		//Primitive referenced by a BVH leaf slot (sphere or triangle)
+		//Sphere references index m_Spheres, triangle references m_PrecomputedTriangles
+		struct PrimitiveRef
+		{
+			uint32_t index{};
+			PrimitiveType type{};
+		};
+
+		//Planes are unbounded and stay on their own list, everything else goes through the BVH
+		BVH m_BVH{};
+		std::vector<PrimitiveRef> m_BVHPrimitives{};
+		bool m_IsAccelerationStructureDirty{ true };
+		uint64_t m_GeometryVersion{};
+		uint64_t m_ShadingVersion{};
+
+		//Packed copies for the batched hit tests, rebuilt with the BVH
+		SphereSoA m_Spheres{}; //BVH leaf order, spheres first in every leaf
+		std::vector<uint32_t> m_SphereMaterialIndices{}; //Same order as m_Spheres, only read to resolve the closest hit
+		PlaneSoA m_Planes{};
+		std::vector<PrecomputedTriangle> m_PrecomputedTriangles{}; //BVH leaf order, triangleIndex points into m_Triangles
+
+		//Mesh or instance referenced by a top level leaf slot
+		struct MeshPlacement
+		{
+			uint32_t meshIndex{};
+			uint32_t instanceIndex{ MeshInstance::noInstance }; //noInstance: the mesh at its own transform
+		};
+
+		//Refitted until its cost grew this much since the last rebuild
+		static constexpr float m_MaxMeshBVHCostRatio{ 1.5f };
+
+		//Top level BVH over the world bounds of the meshes and mesh instances, each mesh owns its bottom level BVH
+		BVH m_MeshBVH{};
+		std::vector<MeshPlacement> m_MeshPlacements{}; //Leaf order
+		float m_MeshBVHBuildCost{};
+		AccelerationStructureStats m_AccelerationStructureStats{};
+
+		uint32_t GetLeafSphereCount(uint32_t first, uint32_t count) const;
+		void BuildMeshBVH(ThreadPool* pThreadPool);
+		//Moves the top level nodes to the current placement bounds, rebuilds instead when the tree got too bad
+		void RefitMeshBVH(ThreadPool* pThreadPool);
+		const AABB& GetPlacementBounds(const MeshPlacement& placement) const;
+		/**
+		 * \brief Brings every mesh and instance transform up to date, rebuilding the bottom levels that changed
+		 * \param pThreadPool updates the meshes and instances in parallel when given
+		 * \param isBottomLevelRebuilt set when a bottom level was rebuilt, the top level can not be refitted then
+		 * \return true when any mesh or instance changed
+		 */
+		bool UpdateMeshes(ThreadPool* pThreadPool, bool& isBottomLevelRebuilt);
+		void GetClosestMeshHit(const Ray& ray, HitCandidate& closest) const;
+		void ResolveHit(const HitCandidate& hit, const Ray& ray, HitRecord& hitRecord) const;
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -118,4 +249,121 @@ namespace dae
 
 		void Initialize() override;
 	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//BVH Benchmark Scene (random spheres and triangles in a 100x100x100 box)
+	class Scene_BVHBenchmark final : public Scene
+	{
+	public:
+		explicit Scene_BVHBenchmark(size_t primitiveCount) : m_PrimitiveCount{ primitiveCount } {}
+		~Scene_BVHBenchmark() override = default;
+
+		Scene_BVHBenchmark(const Scene_BVHBenchmark&) = delete;
+		Scene_BVHBenchmark(Scene_BVHBenchmark&&) noexcept = delete;
+		Scene_BVHBenchmark& operator=(const Scene_BVHBenchmark&) = delete;
+		Scene_BVHBenchmark& operator=(Scene_BVHBenchmark&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		size_t m_PrimitiveCount{};
+	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//Stress Scenes (benchmark suite), generated with a fixed seed so every run traces the same scene
+
+	//spheresPerAxis^3 spheres on a grid above a floor, mixed Lambert and Cook-Torrance materials
+	class Scene_SphereGrid final : public Scene
+	{
+	public:
+		explicit Scene_SphereGrid(int spheresPerAxis) : m_SpheresPerAxis{ spheresPerAxis } {}
+		~Scene_SphereGrid() override = default;
+
+		Scene_SphereGrid(const Scene_SphereGrid&) = delete;
+		Scene_SphereGrid(Scene_SphereGrid&&) noexcept = delete;
+		Scene_SphereGrid& operator=(const Scene_SphereGrid&) = delete;
+		Scene_SphereGrid& operator=(Scene_SphereGrid&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		int m_SpheresPerAxis{};
+	};
+
+	//One triangle mesh of randomly placed and oriented triangles, no culling
+	class Scene_TriangleSoup final : public Scene
+	{
+	public:
+		explicit Scene_TriangleSoup(size_t triangleCount) : m_TriangleCount{ triangleCount } {}
+		~Scene_TriangleSoup() override = default;
+
+		Scene_TriangleSoup(const Scene_TriangleSoup&) = delete;
+		Scene_TriangleSoup(Scene_TriangleSoup&&) noexcept = delete;
+		Scene_TriangleSoup& operator=(const Scene_TriangleSoup&) = delete;
+		Scene_TriangleSoup& operator=(Scene_TriangleSoup&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		size_t m_TriangleCount{};
+	};
+
+	//The W3 room lit by lightCount point lights, shading and shadow rays dominate
+	class Scene_ManyLights final : public Scene
+	{
+	public:
+		explicit Scene_ManyLights(int lightCount) : m_LightCount{ lightCount } {}
+		~Scene_ManyLights() override = default;
+
+		Scene_ManyLights(const Scene_ManyLights&) = delete;
+		Scene_ManyLights(Scene_ManyLights&&) noexcept = delete;
+		Scene_ManyLights& operator=(const Scene_ManyLights&) = delete;
+		Scene_ManyLights& operator=(Scene_ManyLights&&) noexcept = delete;
+
+		void Initialize() override;
+
+	private:
+		int m_LightCount{};
+	};
+
+	//instancesPerAxis^2 instances of one rock mesh on a floor, each with its own rotation, scale and material
+	//The rocks wander around their grid position while the scene is updated
+	class Scene_MeshInstances final : public Scene
+	{
+	public:
+		explicit Scene_MeshInstances(int instancesPerAxis) : m_InstancesPerAxis{ instancesPerAxis } {}
+		~Scene_MeshInstances() override = default;
+
+		Scene_MeshInstances(const Scene_MeshInstances&) = delete;
+		Scene_MeshInstances(Scene_MeshInstances&&) noexcept = delete;
+		Scene_MeshInstances& operator=(const Scene_MeshInstances&) = delete;
+		Scene_MeshInstances& operator=(Scene_MeshInstances&&) noexcept = delete;
+
+		void Initialize() override;
+		void Update(dae::Timer* pTimer) override;
+		//Moves every rock to where it is at time (seconds), time 0 is the layout of Initialize
+		void Animate(float time);
+
+	private:
+		//Placement of the rock of the instance with the same index
+		struct Rock
+		{
+			Vector3 position{};
+			float scale{};
+			float yaw{};
+			float speed{}; //Radians per second around its circle, negative turns the other way
+		};
+
+		int m_InstancesPerAxis{};
+		std::vector<Rock> m_Rocks{};
+	};
+
+	/**
+	 * \brief Creates one of the built-in scenes by name (W1 - W4, or a stress scene at its default size), not initialized yet
+	 * \param name scene name, as listed by GetSceneNames, or the path of a .scene file (see Scene_File)
+	 * \param pThreadPool loads the meshes of a .scene file in parallel when given, it has to outlive Initialize
+	 * \return new scene owned by the caller, nullptr when the name is unknown
+	 */
+	Scene* CreateScene(const std::string& name, ThreadPool* pThreadPool = nullptr);
+	std::vector<std::string> GetSceneNames();
 }
@@ -0,0 +1,413 @@
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace dae
+{
+	namespace
+	{
+		//Bump on every change of the header or of Sphere/Triangle, older sidecars are then rejected
+		constexpr uint32_t g_SidecarVersion{ 1 };
+		constexpr char g_SidecarMagic[8]{ 'D', 'A', 'E', 'P', 'R', 'I', 'M', '\0' };
+
+		static_assert(std::is_trivially_copyable_v<Sphere> && std::is_trivially_copyable_v<Triangle>,
+			"Sidecar records are copied as raw bytes");
+
+		enum class RecordType : uint32_t
+		{
+			Sphere = 1,
+			Triangle = 2
+		};
+
+		//The records follow right behind the header, tightly packed
+		struct SidecarHeader
+		{
+			char magic[8]{};
+			uint32_t version{};
+			RecordType recordType{};
+			uint32_t recordSize{}; //Of the writer, a build with another layout rejects the file
+			uint32_t padding{};
+			uint64_t recordCount{};
+		};
+
+		template<typename Record>
+		bool WriteSidecar(const std::string& path, RecordType recordType, const Record* pRecords, size_t count)
+		{
+			SidecarHeader header{};
+			std::memcpy(header.magic, g_SidecarMagic, sizeof(g_SidecarMagic));
+			header.version = g_SidecarVersion;
+			header.recordType = recordType;
+			header.recordSize = sizeof(Record);
+			header.recordCount = count;
+
+			std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(SidecarHeader));
+			file.write(reinterpret_cast<const char*>(pRecords), static_cast<std::streamsize>(count * sizeof(Record)));
+			return static_cast<bool>(file);
+		}
+
+		//Maps a sidecar and points pRecords at its records, nothing is copied yet
+		template<typename Record>
+		bool MapSidecar(MappedFile& file, const std::string& path, RecordType recordType, const Record*& pRecords, size_t& count, std::string& reason)
+		{
+			if (!file.Open(path))
+			{
+				reason = "can not open " + path;
+				return false;
+			}
+
+			SidecarHeader header{};
+			if (file.GetSize() >= sizeof(SidecarHeader))
+				std::memcpy(&header, file.GetData(), sizeof(SidecarHeader));
+
+			const size_t recordBytes{ file.GetSize() - std::min(file.GetSize(), sizeof(SidecarHeader)) };
+			const bool isValid{ file.GetSize() >= sizeof(SidecarHeader)
+				&& std::memcmp(header.magic, g_SidecarMagic, sizeof(g_SidecarMagic)) == 0
+				&& header.version == g_SidecarVersion
+				&& header.recordType == recordType
+				&& header.recordSize == sizeof(Record)
+				&& header.recordCount == recordBytes / sizeof(Record)
+				&& recordBytes % sizeof(Record) == 0 };
+			if (!isValid)
+			{
+				reason = path + " is not a sidecar of this kind and version, or it is truncated";
+				return false;
+			}
+
+			pRecords = reinterpret_cast<const Record*>(file.GetData() + sizeof(SidecarHeader));
+			count = header.recordCount;
+			return true;
+		}
+
+		bool Read(std::istream& stream, float& value)
+		{
+			return static_cast<bool>(stream >> value);
+		}
+
+		bool Read(std::istream& stream, Vector3& value)
+		{
+			return static_cast<bool>(stream >> value.x >> value.y >> value.z);
+		}
+
+		bool Read(std::istream& stream, ColorRGB& value)
+		{
+			return static_cast<bool>(stream >> value.r >> value.g >> value.b);
+		}
+
+		bool Read(std::istream& stream, TriangleCullMode& value)
+		{
+			std::string name{};
+			stream >> name;
+			if (name == "none")
+				value = TriangleCullMode::NoCulling;
+			else if (name == "back")
+				value = TriangleCullMode::BackFaceCulling;
+			else if (name == "front")
+				value = TriangleCullMode::FrontFaceCulling;
+			else
+				return false;
+			return true;
+		}
+
+		bool IsAtEnd(std::istream& stream)
+		{
+			stream >> std::ws;
+			return stream.eof();
+		}
+
+		bool ReadCamera(std::istream& stream, Camera& camera)
+		{
+			std::string property{};
+			stream >> property;
+
+			float angle{};
+			if (property == "origin")
+				return Read(stream, camera.origin);
+			if (property == "fov")
+				return Read(stream, camera.fovAngle);
+			if (property == "pitch" && Read(stream, angle))
+			{
+				camera.pitch = angle * TO_RADIANS;
+				return true;
+			}
+			if (property == "yaw" && Read(stream, angle))
+			{
+				camera.yaw = angle * TO_RADIANS;
+				return true;
+			}
+			if (property == "orthographicsize")
+				return Read(stream, camera.orthographicSize);
+			if (property == "aperture")
+				return Read(stream, camera.apertureRadius);
+			if (property == "focus")
+				return Read(stream, camera.focusDistance);
+			if (property == "projection")
+			{
+				std::string projection{};
+				stream >> projection;
+				if (projection == "pinhole")
+					camera.projection = ProjectionType::Pinhole;
+				else if (projection == "orthographic")
+					camera.projection = ProjectionType::Orthographic;
+				else if (projection == "thinlens")
+					camera.projection = ProjectionType::ThinLens;
+				else
+					return false;
+				return true;
+			}
+			return false;
+		}
+	}
+
+	namespace SceneFile
+	{
+		bool WriteSpheres(const std::string& path, const Sphere* pSpheres, size_t count)
+		{
+			return WriteSidecar(path, RecordType::Sphere, pSpheres, count);
+		}
+
+		bool WriteTriangles(const std::string& path, const Triangle* pTriangles, size_t count)
+		{
+			return WriteSidecar(path, RecordType::Triangle, pTriangles, count);
+		}
+	}
+
+	void Scene_File::Initialize()
+	{
+		m_IsLoaded = Load();
+	}
+
+	bool Scene_File::Load()
+	{
+		std::ifstream file{ m_Path };
+		if (!file)
+		{
+			m_Error = m_Path + ": can not be opened";
+			return false;
+		}
+		const std::filesystem::path directory{ std::filesystem::path{ m_Path }.parent_path() };
+
+		std::unordered_map<std::string, uint32_t> materialIndices{ { "default", 0 } };
+		const auto readMaterial = [&](std::istream& stream, uint32_t& materialIndex, std::string& reason)
+			{
+				std::string name{};
+				stream >> name;
+				const auto it{ materialIndices.find(name) };
+				if (it == materialIndices.end())
+				{
+					reason = "unknown material " + name;
+					return false;
+				}
+				materialIndex = it->second;
+				return true;
+			};
+
+		//Text primitives are gathered and added in one go at the end, sidecars are added straight from the mapped file
+		std::vector<Sphere> spheres{};
+		std::vector<Plane> planes{};
+		std::vector<Triangle> triangles{};
+		std::vector<Light> lights{};
+		std::unordered_map<std::string, uint32_t> meshIndices{}; //"<path>|<cull mode>" to the mesh loaded for it
+
+		std::string line{};
+		int lineNumber{};
+		while (std::getline(file, line))
+		{
+			++lineNumber;
+			line.erase(std::min(line.find('#'), line.size()));
+
+			std::istringstream stream{ line };
+			std::string keyword{};
+			if (!(stream >> keyword))
+				continue;
+
+			std::string reason{};
+			bool isValid{ false };
+			if (keyword == "camera")
+			{
+				isValid = ReadCamera(stream, m_Camera);
+			}
+			else if (keyword == "material")
+			{
+				std::string name{};
+				std::string type{};
+				ColorRGB color{};
+				stream >> name >> type;
+				if (materialIndices.contains(name))
+				{
+					reason = "material " + name + " is defined twice";
+				}
+				else if (type == "solid")
+				{
+					isValid = Read(stream, color);
+					if (isValid)
+						materialIndices[name] = AddMaterial(Material_SolidColor{ color });
+				}
+				else if (type == "lambert")
+				{
+					Material_Lambert material{};
+					isValid = Read(stream, material.diffuseColor) && Read(stream, material.diffuseReflectance);
+					if (isValid)
+						materialIndices[name] = AddMaterial(material);
+				}
+				else if (type == "phong")
+				{
+					Material_LambertPhong material{};
+					isValid = Read(stream, material.diffuseColor) && Read(stream, material.diffuseReflectance)
+						&& Read(stream, material.specularReflectance) && Read(stream, material.phongExponent);
+					if (isValid)
+						materialIndices[name] = AddMaterial(material);
+				}
+				else if (type == "cooktorrance")
+				{
+					Material_CookTorrence material{};
+					isValid = Read(stream, material.albedo) && Read(stream, material.metalness) && Read(stream, material.roughness);
+					if (isValid)
+						materialIndices[name] = AddMaterial(material);
+				}
+			}
+			else if (keyword == "pointlight" || keyword == "directionallight")
+			{
+				Light& light{ lights.emplace_back() };
+				light.type = keyword == "pointlight" ? LightType::Point : LightType::Directional;
+				isValid = Read(stream, keyword == "pointlight" ? light.origin : light.direction)
+					&& Read(stream, light.intensity) && Read(stream, light.color);
+			}
+			else if (keyword == "sphere")
+			{
+				Sphere& sphere{ spheres.emplace_back() };
+				isValid = Read(stream, sphere.origin) && Read(stream, sphere.radius) && readMaterial(stream, sphere.materialIndex, reason);
+			}
+			else if (keyword == "plane")
+			{
+				Plane& plane{ planes.emplace_back() };
+				isValid = Read(stream, plane.origin) && Read(stream, plane.normal) && readMaterial(stream, plane.materialIndex, reason);
+			}
+			else if (keyword == "triangle")
+			{
+				Vector3 v0{}, v1{}, v2{};
+				uint32_t materialIndex{};
+				isValid = Read(stream, v0) && Read(stream, v1) && Read(stream, v2) && readMaterial(stream, materialIndex, reason);
+				if (isValid)
+				{
+					Triangle& triangle{ triangles.emplace_back(v0, v1, v2) };
+					triangle.materialIndex = materialIndex;
+					triangle.cullMode = TriangleCullMode::NoCulling;
+
+					std::string option{};
+					if (stream >> option)
+						isValid = option == "cull" && Read(stream, triangle.cullMode);
+				}
+			}
+			else if (keyword == "mesh")
+			{
+				std::string path{};
+				uint32_t materialIndex{};
+				isValid = static_cast<bool>(stream >> path) && readMaterial(stream, materialIndex, reason);
+
+				//Options come in any order, the transforms are applied scale, rotation, translation like TriangleMesh does
+				TriangleCullMode cullMode{ TriangleCullMode::NoCulling };
+				Vector3 translation{};
+				Vector3 scale{ 1.f, 1.f, 1.f };
+				float yaw{};
+				std::string option{};
+				while (isValid && stream >> option)
+				{
+					if (option == "cull")
+						isValid = Read(stream, cullMode);
+					else if (option == "translate")
+						isValid = Read(stream, translation);
+					else if (option == "rotatey")
+						isValid = Read(stream, yaw);
+					else if (option == "scale")
+						isValid = Read(stream, scale);
+					else
+						isValid = false;
+				}
+
+				if (isValid)
+				{
+					//Every mesh line is an instance, lines with the same file and cull mode share one loaded mesh
+					const std::string meshPath{ (directory / path).string() };
+					const std::string meshKey{ meshPath + '|' + std::to_string(static_cast<int>(cullMode)) };
+					auto it{ meshIndices.find(meshKey) };
+					std::string meshError{};
+					if (it == meshIndices.end() && AddTriangleMesh(meshPath, cullMode, materialIndex, m_pThreadPool, &meshError))
+						it = meshIndices.emplace(meshKey, static_cast<uint32_t>(m_TriangleMeshGeometries.size() - 1)).first;
+
+					if (it != meshIndices.end())
+					{
+						const Matrix transform{ Matrix::CreateScale(scale) * Matrix::CreateRotationY(yaw * TO_RADIANS) * Matrix::CreateTranslation(translation) };
+						AddMeshInstance(&m_TriangleMeshGeometries[it->second], transform, materialIndex);
+					}
+					else
+					{
+						isValid = false;
+						reason = "can not load mesh " + (meshError.empty() ? meshPath : meshError);
+					}
+				}
+			}
+			else if (keyword == "spheres")
+			{
+				std::string path{};
+				MappedFile sidecar{};
+				const Sphere* pSpheres{};
+				size_t count{};
+				isValid = static_cast<bool>(stream >> path) && MapSidecar(sidecar, (directory / path).string(), RecordType::Sphere, pSpheres, count, reason);
+				for (size_t i{}; isValid && i < count; ++i)
+				{
+					isValid = pSpheres[i].materialIndex < m_Materials.GetSize();
+					if (!isValid)
+						reason = "sphere " + std::to_string(i) + " of " + path + " uses an undefined material";
+				}
+				if (isValid)
+					AddSpheres(pSpheres, count);
+			}
+			else if (keyword == "triangles")
+			{
+				std::string path{};
+				MappedFile sidecar{};
+				const Triangle* pTriangles{};
+				size_t count{};
+				isValid = static_cast<bool>(stream >> path) && MapSidecar(sidecar, (directory / path).string(), RecordType::Triangle, pTriangles, count, reason);
+				for (size_t i{}; isValid && i < count; ++i)
+				{
+					isValid = pTriangles[i].materialIndex < m_Materials.GetSize()
+						&& static_cast<uint32_t>(pTriangles[i].cullMode) <= static_cast<uint32_t>(TriangleCullMode::NoCulling);
+					if (!isValid)
+						reason = "triangle " + std::to_string(i) + " of " + path + " uses an undefined material or cull mode";
+				}
+				if (isValid)
+					AddTriangles(pTriangles, count);
+			}
+			else
+			{
+				reason = "unknown statement " + keyword;
+			}
+
+			if (isValid && !IsAtEnd(stream))
+				isValid = false;
+			if (!isValid)
+			{
+				m_Error = m_Path + ":" + std::to_string(lineNumber) + ": " + (reason.empty() ? "malformed " + keyword : reason);
+				return false;
+			}
+		}
+
+		AddSpheres(spheres.data(), spheres.size());
+		AddPlanes(planes.data(), planes.size());
+		AddTriangles(triangles.data(), triangles.size());
+		AddLights(lights.data(), lights.size());
+		m_Camera.hasMoved = true;
+		return true;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "Scene.h"
+
+namespace dae
+{
+	//Text scene description, one statement per line, '#' starts a comment. Numbers are separated by spaces, angles are in degrees
+	//  camera origin <x y z> | fov <angle> | pitch <angle> | yaw <angle> | projection <pinhole|orthographic|thinlens>
+	//         | orthographicsize <half height> | aperture <radius> | focus <distance>
+	//  material <name> solid <r g b>
+	//  material <name> lambert <r g b> <reflectance>
+	//  material <name> phong <r g b> <kd> <ks> <exponent>
+	//  material <name> cooktorrance <r g b> <metalness> <roughness>
+	//  pointlight <x y z> <intensity> <r g b>
+	//  directionallight <direction x y z> <intensity> <r g b>
+	//  sphere <x y z> <radius> <material>
+	//  plane <x y z> <normal x y z> <material>
+	//  triangle <x y z> <x y z> <x y z> <material> [cull <none|back|front>]
+	//  mesh <obj path> <material> [cull <none|back|front>] [translate <x y z>] [rotatey <angle>] [scale <x y z>]
+	//           (loaded through the mesh cache, see MeshCache::LoadOBJ, once per file and cull mode: every mesh line is an instance)
+	//  spheres <sidecar path>
+	//  triangles <sidecar path>
+	//The camera statements set up the scene's camera, --projection on the command line overrides its projection.
+	//Materials are referenced by name, "default" is the red solid color every scene starts with. Triangles and meshes are not culled
+	//unless cull says so. Paths are relative to the scene file.
+	//A sidecar is a binary array of spheres or triangles for scenes too big to write out as text (see SceneFile::WriteSpheres),
+	//its material indices count the materials in declaration order with default as 0
+	namespace SceneFile
+	{
+		/**
+		 * \brief Writes a sphere sidecar, the spheres are stored as they are in memory
+		 * \param path sidecar file to write
+		 * \param pSpheres spheres, materialIndex as the scene file will number its materials
+		 * \param count number of spheres
+		 * \return true when the file was written
+		 */
+		bool WriteSpheres(const std::string& path, const Sphere* pSpheres, size_t count);
+		//Triangle version of WriteSpheres, normals and cull modes are stored with the triangles
+		bool WriteTriangles(const std::string& path, const Triangle* pTriangles, size_t count);
+	}
+
+	//Scene read from a scene file by Initialize, check IsLoaded afterwards
+	//Meshes are loaded on pThreadPool when given, it has to outlive Initialize
+	class Scene_File final : public Scene
+	{
+	public:
+		explicit Scene_File(const std::string& path, ThreadPool* pThreadPool = nullptr) : m_Path{ path }, m_pThreadPool{ pThreadPool } {}
+		~Scene_File() override = default;
+
+		Scene_File(const Scene_File&) = delete;
+		Scene_File(Scene_File&&) noexcept = delete;
+		Scene_File& operator=(const Scene_File&) = delete;
+		Scene_File& operator=(Scene_File&&) noexcept = delete;
+
+		void Initialize() override;
+
+		bool IsLoaded() const { return m_IsLoaded; }
+		//Why the file did not load ("<path>:<line>: <reason>"), empty when it did
+		const std::string& GetError() const { return m_Error; }
+
+	private:
+		std::string m_Path{};
+		std::string m_Error{};
+		ThreadPool* m_pThreadPool{};
+		bool m_IsLoaded{ false };
+
+		bool Load();
+	};
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <cstddef>
+#include <immintrin.h>
+#include <new>
+#include <vector>
+
+namespace dae
+{
+	//Splits 4 interleaved xyz vectors (12 floats) into one register per component
+	inline void Deinterleave4(const float* p, __m128& x, __m128& y, __m128& z)
+	{
+		const __m128 a{ _mm_loadu_ps(p) }; //x0 y0 z0 x1
+		const __m128 b{ _mm_loadu_ps(p + 4) }; //y1 z1 x2 y2
+		const __m128 c{ _mm_loadu_ps(p + 8) }; //z2 x3 y3 z3
+		const __m128 xy23{ _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)) }; //x2 y2 x3 y3
+		const __m128 yz01{ _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)) }; //y0 z0 y1 z1
+		x = _mm_shuffle_ps(a, xy23, _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(yz01, xy23, _MM_SHUFFLE(3, 1, 2, 0));
+		z = _mm_shuffle_ps(yz01, c, _MM_SHUFFLE(3, 0, 3, 1));
+	}
+
+	//Inverse of Deinterleave4, writes 12 floats
+	inline void Interleave4(__m128 x, __m128 y, __m128 z, float* p)
+	{
+		const __m128 xy02{ _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0)) }; //x0 x2 y0 y2
+		const __m128 zx01{ _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)) }; //z0 z0 x1 x1
+		const __m128 yz11{ _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)) }; //y1 y1 z1 z1
+		const __m128 zx23{ _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)) }; //z2 z2 x3 x3
+		const __m128 yz33{ _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)) }; //y3 y3 z3 z3
+		_mm_storeu_ps(p, _mm_shuffle_ps(xy02, zx01, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(p + 4, _mm_shuffle_ps(yz11, xy02, _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm_storeu_ps(p + 8, _mm_shuffle_ps(zx23, yz33, _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	//Thin wrapper around the widest float register the build targets (AVX: 8 lanes, SSE: 4 lanes)
+	//Comparisons return lane masks (all bits set for true), to be used with Select/MoveMask
+#if defined(__AVX__)
+	constexpr int SIMD_WIDTH{ 8 };
+
+	struct SimdFloat
+	{
+		__m256 v;
+
+		SimdFloat() : v{ _mm256_setzero_ps() } {}
+		SimdFloat(__m256 _v) : v{ _v } {}
+		SimdFloat(float f) : v{ _mm256_set1_ps(f) } {}
+
+		static SimdFloat Load(const float* p) { return _mm256_loadu_ps(p); }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		float operator[](int lane) const
+		{
+			alignas(32) float lanes[SIMD_WIDTH];
+			_mm256_store_ps(lanes, v);
+			return lanes[lane];
+		}
+
+		SimdFloat operator+(const SimdFloat& o) const { return _mm256_add_ps(v, o.v); }
+		SimdFloat operator-(const SimdFloat& o) const { return _mm256_sub_ps(v, o.v); }
+		SimdFloat operator*(const SimdFloat& o) const { return _mm256_mul_ps(v, o.v); }
+		SimdFloat operator/(const SimdFloat& o) const { return _mm256_div_ps(v, o.v); }
+		SimdFloat operator-() const { return _mm256_xor_ps(v, _mm256_set1_ps(-0.f)); }
+
+		SimdFloat operator<(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LT_OQ); }
+		SimdFloat operator<=(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_LE_OQ); }
+		SimdFloat operator>(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_GT_OQ); }
+		SimdFloat operator>=(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_GE_OQ); }
+		SimdFloat operator!=(const SimdFloat& o) const { return _mm256_cmp_ps(v, o.v, _CMP_NEQ_OQ); }
+		SimdFloat operator&(const SimdFloat& o) const { return _mm256_and_ps(v, o.v); }
+		SimdFloat operator|(const SimdFloat& o) const { return _mm256_or_ps(v, o.v); }
+
+		static SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return _mm256_min_ps(a.v, b.v); }
+		static SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return _mm256_max_ps(a.v, b.v); }
+		static SimdFloat Sqrt(const SimdFloat& a) { return _mm256_sqrt_ps(a.v); }
+		//mask ? a : b
+		static SimdFloat Select(const SimdFloat& mask, const SimdFloat& a, const SimdFloat& b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+		//One bit per lane, lane 0 in the lowest bit
+		static int MoveMask(const SimdFloat& mask) { return _mm256_movemask_ps(mask.v); }
+		//{ 0, 1, 2, ... }, compare against a count to mask off the lanes past the end of a range
+		static SimdFloat LaneIndices() { return _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f); }
+	};
+#else
+	constexpr int SIMD_WIDTH{ 4 };
+
+	struct SimdFloat
+	{
+		__m128 v;
+
+		SimdFloat() : v{ _mm_setzero_ps() } {}
+		SimdFloat(__m128 _v) : v{ _v } {}
+		SimdFloat(float f) : v{ _mm_set1_ps(f) } {}
+
+		static SimdFloat Load(const float* p) { return _mm_loadu_ps(p); }
+		void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+		float operator[](int lane) const
+		{
+			alignas(16) float lanes[SIMD_WIDTH];
+			_mm_store_ps(lanes, v);
+			return lanes[lane];
+		}
+
+		SimdFloat operator+(const SimdFloat& o) const { return _mm_add_ps(v, o.v); }
+		SimdFloat operator-(const SimdFloat& o) const { return _mm_sub_ps(v, o.v); }
+		SimdFloat operator*(const SimdFloat& o) const { return _mm_mul_ps(v, o.v); }
+		SimdFloat operator/(const SimdFloat& o) const { return _mm_div_ps(v, o.v); }
+		SimdFloat operator-() const { return _mm_xor_ps(v, _mm_set1_ps(-0.f)); }
+
+		SimdFloat operator<(const SimdFloat& o) const { return _mm_cmplt_ps(v, o.v); }
+		SimdFloat operator<=(const SimdFloat& o) const { return _mm_cmple_ps(v, o.v); }
+		SimdFloat operator>(const SimdFloat& o) const { return _mm_cmpgt_ps(v, o.v); }
+		SimdFloat operator>=(const SimdFloat& o) const { return _mm_cmpge_ps(v, o.v); }
+		SimdFloat operator!=(const SimdFloat& o) const { return _mm_cmpneq_ps(v, o.v); }
+		SimdFloat operator&(const SimdFloat& o) const { return _mm_and_ps(v, o.v); }
+		SimdFloat operator|(const SimdFloat& o) const { return _mm_or_ps(v, o.v); }
+
+		static SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return _mm_min_ps(a.v, b.v); }
+		static SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return _mm_max_ps(a.v, b.v); }
+		static SimdFloat Sqrt(const SimdFloat& a) { return _mm_sqrt_ps(a.v); }
+		//mask ? a : b (SSE2 only, no blendv)
+		static SimdFloat Select(const SimdFloat& mask, const SimdFloat& a, const SimdFloat& b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+		//One bit per lane, lane 0 in the lowest bit
+		static int MoveMask(const SimdFloat& mask) { return _mm_movemask_ps(mask.v); }
+		//{ 0, 1, 2, ... }, compare against a count to mask off the lanes past the end of a range
+		static SimdFloat LaneIndices() { return _mm_setr_ps(0.f, 1.f, 2.f, 3.f); }
+	};
+#endif
+
+	constexpr size_t SIMD_ALIGNMENT{ SIMD_WIDTH * sizeof(float) };
+
+	//Allocates on SIMD_ALIGNMENT boundaries, so arrays of floats can be loaded a register at a time
+	template<typename T>
+	struct AlignedAllocator
+	{
+		using value_type = T;
+
+		AlignedAllocator() = default;
+		template<typename U>
+		AlignedAllocator(const AlignedAllocator<U>&) {}
+
+		T* allocate(size_t count)
+		{
+			return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{ SIMD_ALIGNMENT }));
+		}
+
+		void deallocate(T* p, size_t)
+		{
+			::operator delete(p, std::align_val_t{ SIMD_ALIGNMENT });
+		}
+
+		template<typename U>
+		bool operator==(const AlignedAllocator<U>&) const { return true; }
+	};
+
+	template<typename T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+	//Three SIMD registers, lane i holds the i-th vector
+	struct SimdVector3
+	{
+		SimdFloat x{};
+		SimdFloat y{};
+		SimdFloat z{};
+
+		SimdVector3() = default;
+		SimdVector3(const SimdFloat& _x, const SimdFloat& _y, const SimdFloat& _z) : x{ _x }, y{ _y }, z{ _z } {}
+		//Broadcast the same vector to every lane
+		SimdVector3(float _x, float _y, float _z) : x{ _x }, y{ _y }, z{ _z } {}
+
+		//SIMD_WIDTH vectors stored as x y z x y z ... (an array of Vector3), 3 * SIMD_WIDTH floats
+		static SimdVector3 LoadInterleaved(const float* p)
+		{
+#if defined(__AVX__)
+			__m128 x0, y0, z0, x1, y1, z1;
+			Deinterleave4(p, x0, y0, z0);
+			Deinterleave4(p + 12, x1, y1, z1);
+			return { _mm256_set_m128(x1, x0), _mm256_set_m128(y1, y0), _mm256_set_m128(z1, z0) };
+#else
+			__m128 x, y, z;
+			Deinterleave4(p, x, y, z);
+			return { x, y, z };
+#endif
+		}
+
+		void StoreInterleaved(float* p) const
+		{
+#if defined(__AVX__)
+			Interleave4(_mm256_castps256_ps128(x.v), _mm256_castps256_ps128(y.v), _mm256_castps256_ps128(z.v), p);
+			Interleave4(_mm256_extractf128_ps(x.v, 1), _mm256_extractf128_ps(y.v, 1), _mm256_extractf128_ps(z.v, 1), p + 12);
+#else
+			Interleave4(x.v, y.v, z.v, p);
+#endif
+		}
+
+		SimdVector3 operator+(const SimdVector3& o) const { return { x + o.x, y + o.y, z + o.z }; }
+		SimdVector3 operator-(const SimdVector3& o) const { return { x - o.x, y - o.y, z - o.z }; }
+		SimdVector3 operator*(const SimdFloat& s) const { return { x * s, y * s, z * s }; }
+
+		static SimdFloat Dot(const SimdVector3& a, const SimdVector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+		static SimdVector3 Cross(const SimdVector3& a, const SimdVector3& b)
+		{
+			return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+		}
+	};
+}
@@ -0,0 +1,57 @@
+#include "Statistics.h"
+
+#include <deque>
+#include <mutex>
+
+namespace dae
+{
+	namespace Statistics
+	{
+		namespace
+		{
+			//Counters outlive their thread, a deque never moves what it already holds
+			struct Registry
+			{
+				std::mutex mutex{};
+				std::deque<TraceCounters> counters{};
+			};
+
+			Registry& GetRegistry()
+			{
+				static Registry registry{};
+				return registry;
+			}
+		}
+
+		TraceCounters& RegisterThread()
+		{
+			Registry& registry{ GetRegistry() };
+			const std::lock_guard lock{ registry.mutex };
+			return registry.counters.emplace_back();
+		}
+
+		TraceCounters Collect()
+		{
+			Registry& registry{ GetRegistry() };
+			const std::lock_guard lock{ registry.mutex };
+
+			TraceCounters total{};
+			for (const TraceCounters& counters : registry.counters)
+			{
+				total += counters;
+			}
+			return total;
+		}
+
+		void Reset()
+		{
+			Registry& registry{ GetRegistry() };
+			const std::lock_guard lock{ registry.mutex };
+
+			for (TraceCounters& counters : registry.counters)
+			{
+				counters = {};
+			}
+		}
+	}
+}
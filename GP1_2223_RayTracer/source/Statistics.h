@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+//The node and primitive tests are only counted in builds with RAYTRACER_STATS (CMake option of the same name), so the
+//traversal loops carry no counting by default. Rays are always counted, once per ray
+#ifdef RAYTRACER_STATS
+#define RAYTRACER_STATS_ONLY(...) __VA_ARGS__
+#else
+#define RAYTRACER_STATS_ONLY(...)
+#endif
+
+namespace dae
+{
+	//Work done by the hit tests, packets count once per active lane so the numbers compare with single rays
+	struct TraceCounters
+	{
+		uint64_t closestHitRays{};
+		uint64_t anyHitRays{}; //Shadow rays
+		uint64_t nodeTests{}; //Ray-AABB tests, both BVH levels (RAYTRACER_STATS builds only)
+		uint64_t primitiveTests{}; //Sphere, plane and triangle tests (RAYTRACER_STATS builds only)
+
+		uint64_t GetRayCount() const { return closestHitRays + anyHitRays; }
+
+		TraceCounters& operator+=(const TraceCounters& other)
+		{
+			closestHitRays += other.closestHitRays;
+			anyHitRays += other.anyHitRays;
+			nodeTests += other.nodeTests;
+			primitiveTests += other.primitiveTests;
+			return *this;
+		}
+	};
+
+	//Every thread counts into its own TraceCounters, so counting stays enabled without contention in the hit tests
+	namespace Statistics
+	{
+		//Creates the counters of the calling thread, use GetCounters instead
+		TraceCounters& RegisterThread();
+
+		inline TraceCounters& GetCounters()
+		{
+			thread_local TraceCounters& counters{ RegisterThread() };
+			return counters;
+		}
+
+		//Sum over every thread, only call while no thread is tracing
+		TraceCounters Collect();
+		//Zeroes the counters of every thread, only call while no thread is tracing
+		void Reset();
+	}
+}
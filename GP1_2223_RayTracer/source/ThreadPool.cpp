@@ -0,0 +1,173 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	namespace
+	{
+		//Pool whose task the thread is running, nullptr outside of tasks
+		thread_local const ThreadPool* g_pTaskPool{};
+	}
+
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		//Queue 0 belongs to the thread that calls RunTasks
+		m_Queues = std::vector<TaskQueue>(threadCount);
+
+		m_Workers.reserve(threadCount - 1);
+		for (uint32_t i{ 1 }; i < threadCount; ++i)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::RunTasks(std::vector<Task>& tasks)
+	{
+		if (tasks.empty())
+			return;
+
+		//The queues and counters belong to the tasks already running, nested tasks must not touch them
+		if (g_pTaskPool == this)
+		{
+			for (Task& task : tasks)
+			{
+				task();
+			}
+			return;
+		}
+
+		const uint32_t threadCount{ GetThreadCount() };
+		m_PendingTasks = static_cast<uint32_t>(tasks.size());
+		for (size_t i{}; i < tasks.size(); ++i)
+		{
+			TaskQueue& queue{ m_Queues[i % threadCount] };
+			std::lock_guard lock{ queue.mutex };
+			queue.tasks.emplace_back(std::move(tasks[i]));
+		}
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_BusyWorkers = static_cast<uint32_t>(m_Workers.size());
+			++m_Generation;
+		}
+		m_WorkAvailable.notify_all();
+
+		RunTaskLoop(0);
+
+		//Wait for the workers to leave the task loop
+		std::unique_lock lock{ m_Mutex };
+		m_WorkDone.wait(lock, [this] { return m_BusyWorkers == 0; });
+	}
+
+	void ThreadPool::ParallelFor(uint32_t jobCount, const std::function<void(uint32_t)>& job)
+	{
+		if (jobCount == 0)
+			return;
+
+		//One task per thread, jobs are handed out one at a time so faster threads simply take more of them
+		std::atomic<uint32_t> nextJob{};
+		std::vector<Task> tasks(std::min(jobCount, GetThreadCount()), [&]
+			{
+				for (uint32_t jobIndex{ nextJob++ }; jobIndex < jobCount; jobIndex = nextJob++)
+				{
+					job(jobIndex);
+				}
+			});
+
+		RunTasks(tasks);
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t threadIndex)
+	{
+		uint64_t generation{};
+		while (true)
+		{
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WorkAvailable.wait(lock, [&] { return m_IsStopping || m_Generation != generation; });
+				if (m_IsStopping)
+					return;
+
+				generation = m_Generation;
+			}
+
+			RunTaskLoop(threadIndex);
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_BusyWorkers;
+			}
+			m_WorkDone.notify_one();
+		}
+	}
+
+	void ThreadPool::RunTaskLoop(uint32_t threadIndex)
+	{
+		Task task{};
+		while (m_PendingTasks > 0)
+		{
+			if (TryPopTask(threadIndex, task))
+			{
+				g_pTaskPool = this;
+				task();
+				g_pTaskPool = nullptr;
+				task = nullptr;
+				--m_PendingTasks;
+			}
+			else
+			{
+				//Everything left is already running on other threads
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	bool ThreadPool::TryPopTask(uint32_t threadIndex, Task& task)
+	{
+		//Own work first, newest task at the back
+		{
+			TaskQueue& queue{ m_Queues[threadIndex] };
+			std::lock_guard lock{ queue.mutex };
+			if (!queue.tasks.empty())
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+				return true;
+			}
+		}
+
+		//Steal the oldest task of the next thread that still has work
+		const uint32_t threadCount{ GetThreadCount() };
+		for (uint32_t offset{ 1 }; offset < threadCount; ++offset)
+		{
+			TaskQueue& queue{ m_Queues[(threadIndex + offset) % threadCount] };
+			std::lock_guard lock{ queue.mutex };
+			if (!queue.tasks.empty())
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent worker threads, created once and reused every frame
+	//Every thread owns a task deque: it pops its own tasks from the back and steals from the front of the others
+	//A task may call RunTasks or ParallelFor of the pool it runs on (also through ParallelForBlocks), the nested tasks
+	//then run inline on that thread, in order: one set of tasks is spread over the threads at a time.
+	//Threads outside the pool must not call it at the same time
+	class ThreadPool final
+	{
+	public:
+		using Task = std::function<void()>;
+
+		//threadCount includes the calling thread, 0 uses every hardware thread
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+		/**
+		 * \brief Deals the tasks round robin over the thread deques and blocks until all of them ran, the calling thread helps out.
+		 * Called from a task of this pool, the tasks run inline on the calling thread instead
+		 * \param tasks tasks to run, a thread runs its own tasks back to front
+		 */
+		void RunTasks(std::vector<Task>& tasks);
+
+		/**
+		 * \brief Runs job(index) for every index in [0, jobCount)
+		 * \param jobCount number of jobs
+		 * \param job function executed once per job index, must be safe to call from several threads
+		 */
+		void ParallelFor(uint32_t jobCount, const std::function<void(uint32_t)>& job);
+
+	private:
+		struct TaskQueue
+		{
+			std::mutex mutex{};
+			std::deque<Task> tasks{};
+		};
+
+		std::vector<std::thread> m_Workers{};
+		std::vector<TaskQueue> m_Queues{};
+		std::atomic<uint32_t> m_PendingTasks{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkDone{};
+		uint32_t m_BusyWorkers{};
+		uint64_t m_Generation{};
+		bool m_IsStopping{ false };
+
+		void WorkerLoop(uint32_t threadIndex);
+		void RunTaskLoop(uint32_t threadIndex);
+		bool TryPopTask(uint32_t threadIndex, Task& task);
+	};
+
+	/**
+	 * \brief Splits [0, count) into blocks and runs func(first, end) once per block, the blocks are the same with or without a pool
+	 * \param pThreadPool runs the blocks in parallel when given, nullptr runs them in order on the calling thread
+	 * \param count number of items
+	 * \param blockSize items per block (the last block may be smaller)
+	 * \param func void(size_t first, size_t end), must be safe to call from several threads
+	 */
+	template<typename Func>
+	void ParallelForBlocks(ThreadPool* pThreadPool, size_t count, size_t blockSize, const Func& func)
+	{
+		const size_t blockCount{ (count + blockSize - 1) / blockSize };
+		const auto runBlock = [&](size_t block) { func(block * blockSize, std::min(count, (block + 1) * blockSize)); };
+		if (!pThreadPool || blockCount <= 1)
+		{
+			for (size_t block{}; block < blockCount; ++block)
+			{
+				runBlock(block);
+			}
+			return;
+		}
+
+		pThreadPool->ParallelFor(static_cast<uint32_t>(blockCount), [&](uint32_t block) { runBlock(block); });
+	}
+}
@@ -1,8 +1,10 @@
 #pragma once
+#include <bit>
 #include <cassert>
-#include <fstream>
 #include "Math.h"
 #include "DataTypes.h"
+#include "RayPacket.h"
+#include "Statistics.h"
 
 namespace dae
 {
@@ -10,7 +12,8 @@ namespace dae
 	{
 #pragma region Sphere HitTest
 		//SPHERE HIT-TESTS
-		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Distance only version, t is only written on a hit
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, float& t)
 		{
 			float a { Vector3::Dot(ray.direction, ray.direction) };
 			Vector3 oDiff{ ray.origin - sphere.origin };
@@ -24,20 +27,16 @@ namespace dae
 			if (d > 0)
 			{
 				//Use subtraction, except when t < tMin, then use addition for t.
-				float t = (-b - sqrtf(d)) / 2 / a;
+				float distance = (-b - sqrtf(d)) / 2 / a;
 
-				if (t < ray.min)
+				if (distance < ray.min)
 				{
-					t = (-b + sqrtf(d)) / 2 / a;
+					distance = (-b + sqrtf(d)) / 2 / a;
 				}
 
-				if (t>= ray.min && t <= ray.max)
+				if (distance >= ray.min && distance <= ray.max)
 				{
-					hitRecord.t = t;
-					hitRecord.didHit = true;
-					hitRecord.origin = ray.origin + t * ray.direction;
-					hitRecord.materialIndex = sphere.materialIndex;
-					hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+					t = distance;
 					return true;
 				}
 			}
@@ -45,196 +44,457 @@ namespace dae
 			return false;
 		}
 
+		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t{};
+			if (!HitTest_Sphere(sphere, ray, t)) return false;
+			if (ignoreHitRecord) return true;
+
+			hitRecord.t = t;
+			hitRecord.didHit = true;
+			hitRecord.origin = ray.origin + t * ray.direction;
+			hitRecord.materialIndex = sphere.materialIndex;
+			hitRecord.normal = (hitRecord.origin - sphere.origin).Normalized();
+			return true;
+		}
+
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Sphere(sphere, ray, temp, true);
+			float t{};
+			return HitTest_Sphere(sphere, ray, t);
 		}
 #pragma endregion
 #pragma region Plane HitTest
 		//PLANE HIT-TESTS
-		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Distance only version, t is only written on a hit
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, float& t)
 		{
-			//todo W1
 			const float dotProduct{ Vector3::Dot(ray.direction, plane.normal) };
 
 			if (dotProduct < 0)
 			{
-				float t = Vector3::Dot(plane.origin - ray.origin, plane.normal) / dotProduct;
+				const float distance = Vector3::Dot(plane.origin - ray.origin, plane.normal) / dotProduct;
 
-				if (t >= ray.min && t <= ray.max)
+				if (distance >= ray.min && distance <= ray.max)
 				{
-					hitRecord.t = t;
-					hitRecord.didHit = true;
-					hitRecord.materialIndex = plane.materialIndex;
-					hitRecord.normal = plane.normal;
-					hitRecord.origin = ray.origin + t * ray.direction;
+					t = distance;
 					return true;
 				}
 			}
 			return false;
 		}
 
+		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			float t{};
+			if (!HitTest_Plane(plane, ray, t)) return false;
+			if (ignoreHitRecord) return true;
+
+			hitRecord.t = t;
+			hitRecord.didHit = true;
+			hitRecord.materialIndex = plane.materialIndex;
+			hitRecord.normal = plane.normal;
+			hitRecord.origin = ray.origin + t * ray.direction;
+			return true;
+		}
+
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Plane(plane, ray, temp, true);
+			float t{};
+			return HitTest_Plane(plane, ray, t);
 		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		/**
+		 * \brief Moller-Trumbore test against a precomputed triangle
+		 * \param triangle triangle to test
+		 * \param ray ray to test
+		 * \param t distance along the ray, only written on a hit
+		 * \return true when the ray hits the triangle within [ray.min, ray.max]
+		 */
+		inline bool HitTest_Triangle(const PrecomputedTriangle& triangle, const Ray& ray, float& t)
 		{
-			const Vector3 a{ triangle.v1 - triangle.v0 };
-			const Vector3 b{ triangle.v2 - triangle.v0 };
-			const Vector3 c{ triangle.v2 - triangle.v1 };
-			
-			const Vector3 normal{ Vector3::Cross(a,b) };
+			//det = -dot(normal, direction), so the sign tells which side the ray comes from
+			const Vector3 pVec{ Vector3::Cross(ray.direction, triangle.edge2) };
+			const float det{ Vector3::Dot(triangle.edge1, pVec) };
 
-			if (Vector3::Dot(normal, ray.direction) == 0) return false;
+			switch (triangle.cullMode)
+			{
+			case TriangleCullMode::BackFaceCulling:
+				if (det <= 0.f) return false;
+				break;
+			case TriangleCullMode::FrontFaceCulling:
+				if (det >= 0.f) return false;
+				break;
+			case TriangleCullMode::NoCulling:
+				if (det == 0.f) return false;
+				break;
+			}
 
-			if (Vector3::Dot(normal, ray.direction) > 0 &&
-				triangle.cullMode == TriangleCullMode::BackFaceCulling) return false;
+			const float invDet{ 1.f / det };
+			const Vector3 tVec{ ray.origin - triangle.v0 };
+			const float u{ Vector3::Dot(tVec, pVec) * invDet };
+			if (u < 0.f || u > 1.f) return false;
 
-			if (Vector3::Dot(normal, ray.direction) < 0 &&
-				triangle.cullMode == TriangleCullMode::FrontFaceCulling) return false;
+			const Vector3 qVec{ Vector3::Cross(tVec, triangle.edge1) };
+			const float v{ Vector3::Dot(ray.direction, qVec) * invDet };
+			if (v < 0.f || u + v > 1.f) return false;
 
-			const Vector3 center{ (triangle.v0 + triangle.v1 + triangle.v2) / 3.f };
-			const Vector3 L{ center - ray.origin };
-			const float t{ Vector3::Dot(L, normal) / Vector3::Dot(ray.direction, normal) };
+			const float distance{ Vector3::Dot(triangle.edge2, qVec) * invDet };
+			if (distance < ray.min || distance > ray.max) return false;
 
-			if (t < ray.min || t > ray.max) return false;
+			t = distance;
+			return true;
+		}
 
-			const Vector3 p{ ray.origin + t * ray.direction };
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const PrecomputedTriangle precomputed{ triangle, 0 };
+
+			float t{};
+			if (!HitTest_Triangle(precomputed, ray, t)) return false;
+			if (ignoreHitRecord) return true;
 
-			if (Vector3::Dot(normal, Vector3::Cross(a, p - triangle.v0)) < 0) return false;
-			if (Vector3::Dot(normal, Vector3::Cross(-b, p - triangle.v2)) < 0) return false;
-			if (Vector3::Dot(normal, Vector3::Cross(c, p - triangle.v1)) < 0) return false;
-				
 			hitRecord.didHit = true;
 			hitRecord.t = t;
-			hitRecord.normal = normal;
-			hitRecord.origin = p;
+			hitRecord.normal = Vector3::Cross(precomputed.edge1, precomputed.edge2).Normalized();
+			hitRecord.origin = ray.origin + t * ray.direction;
 			hitRecord.materialIndex = triangle.materialIndex;
 			return true;
 		}
 
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			float t{};
+			return HitTest_Triangle(PrecomputedTriangle{ triangle, 0 }, ray, t);
 		}
 #pragma endregion
-#pragma region TriangeMesh HitTest
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+#pragma region Packet HitTests
+		//PACKET HIT-TESTS (one primitive against every lane, hit lanes get their tMax shrunk to the hit distance)
+		inline int HitTest_Sphere(const Sphere& sphere, RayPacket& packet)
 		{
-			//todo W5
-			assert(false && "No Implemented Yet!");
-			return false;
-		}
+			const SimdVector3 oDiff{ packet.origin - SimdVector3{ sphere.origin.x, sphere.origin.y, sphere.origin.z } };
+			const SimdFloat a{ SimdVector3::Dot(packet.direction, packet.direction) };
+			const SimdFloat b{ SimdFloat{ 2.f } * SimdVector3::Dot(packet.direction, oDiff) };
+			const SimdFloat c{ SimdVector3::Dot(oDiff, oDiff) - SimdFloat{ sphere.radius * sphere.radius } };
 
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
-		{
-			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			const SimdFloat d{ b * b - SimdFloat{ 4.f } * a * c };
+			const SimdFloat hasRoots{ d > SimdFloat{} };
+			if (SimdFloat::MoveMask(hasRoots) == 0)
+				return 0;
+
+			//Same as the single ray test: the near root, unless it lies before tMin
+			const SimdFloat sqrtD{ SimdFloat::Sqrt(SimdFloat::Max(d, SimdFloat{})) };
+			const SimdFloat twoA{ SimdFloat{ 2.f } * a };
+			const SimdFloat tMin{ packet.tMin };
+			SimdFloat t{ (-b - sqrtD) / twoA };
+			t = SimdFloat::Select(t < tMin, (-b + sqrtD) / twoA, t);
+
+			const SimdFloat hit{ hasRoots & (t >= tMin) & (t < packet.tMax) };
+			packet.tMax = SimdFloat::Select(hit, t, packet.tMax);
+			return SimdFloat::MoveMask(hit);
 		}
-#pragma endregion
-	}
 
-	namespace LightUtils
-	{
-		//Direction from target to light
-		inline Vector3 GetDirectionToLight(const Light& light, const Vector3 origin)
+		inline int HitTest_Plane(const Plane& plane, RayPacket& packet)
 		{
-			
-			return light.origin - origin;
+			const SimdVector3 normal{ plane.normal.x, plane.normal.y, plane.normal.z };
+			const SimdFloat dotProduct{ SimdVector3::Dot(packet.direction, normal) };
+			const SimdFloat facing{ dotProduct < SimdFloat{} };
+			if (SimdFloat::MoveMask(facing) == 0)
+				return 0;
+
+			const SimdVector3 toPlane{ SimdVector3{ plane.origin.x, plane.origin.y, plane.origin.z } - packet.origin };
+			const SimdFloat t{ SimdVector3::Dot(toPlane, normal) / dotProduct };
+
+			const SimdFloat hit{ facing & (t >= SimdFloat{ packet.tMin }) & (t < packet.tMax) };
+			packet.tMax = SimdFloat::Select(hit, t, packet.tMax);
+			return SimdFloat::MoveMask(hit);
 		}
 
-		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		inline int HitTest_Triangle(const PrecomputedTriangle& triangle, RayPacket& packet)
 		{
-			if(light.type == LightType::Directional)
-			{
-				return  light.color * light.intensity;
-			}else
+			//Moller-Trumbore, det = -dot(normal, direction) so the sign tells which side the ray comes from
+			const SimdVector3 e1{ triangle.edge1.x, triangle.edge1.y, triangle.edge1.z };
+			const SimdVector3 e2{ triangle.edge2.x, triangle.edge2.y, triangle.edge2.z };
+
+			const SimdVector3 pVec{ SimdVector3::Cross(packet.direction, e2) };
+			const SimdFloat det{ SimdVector3::Dot(e1, pVec) };
+
+			const SimdFloat zero{};
+			SimdFloat valid{};
+			switch (triangle.cullMode)
 			{
-				Vector3 diff = (light.origin - target);
-				return light.color * (light.intensity/Vector3::Dot(diff,diff));
+			case TriangleCullMode::BackFaceCulling:
+				valid = det > zero;
+				break;
+			case TriangleCullMode::FrontFaceCulling:
+				valid = det < zero;
+				break;
+			case TriangleCullMode::NoCulling:
+				valid = det != zero;
+				break;
 			}
+			if (SimdFloat::MoveMask(valid) == 0)
+				return 0;
+
+			const SimdFloat invDet{ SimdFloat{ 1.f } / det };
+			const SimdVector3 tVec{ packet.origin - SimdVector3{ triangle.v0.x, triangle.v0.y, triangle.v0.z } };
+			const SimdFloat u{ SimdVector3::Dot(tVec, pVec) * invDet };
+			const SimdVector3 qVec{ SimdVector3::Cross(tVec, e1) };
+			const SimdFloat v{ SimdVector3::Dot(packet.direction, qVec) * invDet };
+			const SimdFloat t{ SimdVector3::Dot(e2, qVec) * invDet };
+
+			const SimdFloat one{ 1.f };
+			const SimdFloat hit{ valid & (u >= zero) & (v >= zero) & (u + v <= one)
+				& (t >= SimdFloat{ packet.tMin }) & (t < packet.tMax) };
+			packet.tMax = SimdFloat::Select(hit, t, packet.tMax);
+			return SimdFloat::MoveMask(hit);
 		}
-	}
+#pragma endregion
+#pragma region Batched HitTests
+		//BATCHED HIT-TESTS (one ray against SIMD_WIDTH primitives of a structure of arrays at a time)
+		//Same math as the single primitive tests, so the closest hit does not depend on which version found it
 
-	namespace Utils
-	{
-		//Just parses vertices and indices
-#pragma warning(push)
-#pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		/**
+		 * \brief Closest hit of a ray against a range of spheres
+		 * \param spheres sphere store
+		 * \param first first sphere to test
+		 * \param count number of spheres to test
+		 * \param ray ray to test
+		 * \param tMax closest hit so far, only closer hits count and shrink it
+		 * \return index of the closest sphere hit, -1 when none is closer than tMax
+		 */
+		inline int HitTest_Spheres(const SphereSoA& spheres, size_t first, size_t count, const Ray& ray, float& tMax)
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
+			const SimdVector3 rayOrigin{ ray.origin.x, ray.origin.y, ray.origin.z };
+			const SimdVector3 rayDirection{ ray.direction.x, ray.direction.y, ray.direction.z };
+			const SimdFloat a{ Vector3::Dot(ray.direction, ray.direction) };
+			const SimdFloat fourA{ SimdFloat{ 4.f } * a };
+			const SimdFloat twoA{ SimdFloat{ 2.f } * a };
+			const SimdFloat rayMin{ ray.min };
+			const SimdFloat rayMax{ ray.max };
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			int closestIndex{ -1 };
+			for (size_t batch{}; batch < count; batch += SIMD_WIDTH)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
+				const size_t index{ first + batch };
+				const SimdVector3 center{ SimdFloat::Load(&spheres.originX[index]), SimdFloat::Load(&spheres.originY[index]), SimdFloat::Load(&spheres.originZ[index]) };
+				const SimdFloat radius{ SimdFloat::Load(&spheres.radius[index]) };
+
+				const SimdVector3 oDiff{ rayOrigin - center };
+				const SimdFloat b{ SimdFloat{ 2.f } * SimdVector3::Dot(rayDirection, oDiff) };
+				const SimdFloat c{ SimdVector3::Dot(oDiff, oDiff) - radius * radius };
+				const SimdFloat d{ b * b - fourA * c };
+
+				const SimdFloat inRange{ SimdFloat::LaneIndices() < SimdFloat{ static_cast<float>(count - batch) } };
+				const SimdFloat hasRoots{ inRange & (d > SimdFloat{}) };
+				if (SimdFloat::MoveMask(hasRoots) == 0)
+					continue;
+
+				const SimdFloat sqrtD{ SimdFloat::Sqrt(SimdFloat::Max(d, SimdFloat{})) };
+				SimdFloat t{ (-b - sqrtD) / twoA };
+				t = SimdFloat::Select(t < rayMin, (-b + sqrtD) / twoA, t);
+
+				int hitMask{ SimdFloat::MoveMask(hasRoots & (t >= rayMin) & (t <= rayMax) & (t < SimdFloat{ tMax })) };
+				if (hitMask == 0)
+					continue;
+
+				//Lowest lane first, so ties go to the first sphere like they do in the single sphere loop
+				alignas(SIMD_ALIGNMENT) float distances[SIMD_WIDTH];
+				t.Store(distances);
+				for (; hitMask != 0; hitMask &= hitMask - 1)
 				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
+					const int lane{ std::countr_zero(static_cast<unsigned int>(hitMask)) };
+					if (distances[lane] < tMax)
+					{
+						tMax = distances[lane];
+						closestIndex = static_cast<int>(index) + lane;
+					}
 				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+			}
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
+			return closestIndex;
+		}
 
-				if (file.eof()) 
-					break;
-			}
+		/**
+		 * \brief Any hit of a ray against a range of spheres
+		 * \return true when any sphere is hit within [ray.min, ray.max]
+		 */
+		inline bool HitTest_Spheres(const SphereSoA& spheres, size_t first, size_t count, const Ray& ray)
+		{
+			float tMax{ FLT_MAX };
+			return HitTest_Spheres(spheres, first, count, ray, tMax) != -1;
+		}
+
+		/**
+		 * \brief Closest hit of a ray against every plane
+		 * \param planes plane store
+		 * \param ray ray to test
+		 * \param tMax closest hit so far, only closer hits count and shrink it
+		 * \return index of the closest plane hit, -1 when none is closer than tMax
+		 */
+		inline int HitTest_Planes(const PlaneSoA& planes, const Ray& ray, float& tMax)
+		{
+			const SimdVector3 rayOrigin{ ray.origin.x, ray.origin.y, ray.origin.z };
+			const SimdVector3 rayDirection{ ray.direction.x, ray.direction.y, ray.direction.z };
+			const SimdFloat rayMin{ ray.min };
+			const SimdFloat rayMax{ ray.max };
 
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
+			int closestIndex{ -1 };
+			for (size_t index{}; index < planes.count; index += SIMD_WIDTH)
 			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
+				const SimdVector3 normal{ SimdFloat::Load(&planes.normalX[index]), SimdFloat::Load(&planes.normalY[index]), SimdFloat::Load(&planes.normalZ[index]) };
+				const SimdFloat dotProduct{ SimdVector3::Dot(rayDirection, normal) };
 
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
+				//Padding lanes have a zero normal and never face the ray
+				const SimdFloat facing{ dotProduct < SimdFloat{} };
+				if (SimdFloat::MoveMask(facing) == 0)
+					continue;
 
-				if(isnan(normal.x))
+				const SimdVector3 origin{ SimdFloat::Load(&planes.originX[index]), SimdFloat::Load(&planes.originY[index]), SimdFloat::Load(&planes.originZ[index]) };
+				const SimdFloat t{ SimdVector3::Dot(origin - rayOrigin, normal) / SimdFloat::Select(facing, dotProduct, SimdFloat{ -1.f }) };
+
+				int hitMask{ SimdFloat::MoveMask(facing & (t >= rayMin) & (t <= rayMax) & (t < SimdFloat{ tMax })) };
+				if (hitMask == 0)
+					continue;
+
+				alignas(SIMD_ALIGNMENT) float distances[SIMD_WIDTH];
+				t.Store(distances);
+				for (; hitMask != 0; hitMask &= hitMask - 1)
 				{
-					int k = 0;
+					const int lane{ std::countr_zero(static_cast<unsigned int>(hitMask)) };
+					if (distances[lane] < tMax)
+					{
+						tMax = distances[lane];
+						closestIndex = static_cast<int>(index) + lane;
+					}
 				}
+			}
+
+			return closestIndex;
+		}
+
+		/**
+		 * \brief Any hit of a ray against every plane
+		 * \return true when any plane is hit within [ray.min, ray.max]
+		 */
+		inline bool HitTest_Planes(const PlaneSoA& planes, const Ray& ray)
+		{
+			float tMax{ FLT_MAX };
+			return HitTest_Planes(planes, ray, tMax) != -1;
+		}
+#pragma endregion
+#pragma region TriangeMesh HitTest
+		/**
+		 * \brief Closest hit against a mesh placed by a transform, distance and triangle only
+		 * \param mesh mesh to test
+		 * \param inverseTransform world to object space, of the mesh itself or of one of its instances
+		 * \param ray world space ray
+		 * \param tMax closest hit so far, only closer hits count and shrink it
+		 * \param triangleIndex triangle that was hit (leaf order, see TriangleMesh::GetWorldNormal), only written on a hit
+		 * \return true when a triangle closer than tMax was hit
+		 */
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Matrix& inverseTransform, const Ray& ray, float& tMax, uint32_t& triangleIndex)
+		{
+			//Move the ray into object space, the direction is not renormalized so t stays valid in world space
+			const Ray objectRay{ inverseTransform.TransformPoint(ray.origin), inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
 
-				normal.Normalize();
-				if (isnan(normal.x))
+			bool didHit{ false };
+			mesh.bvh.Traverse(objectRay, tMax, [&](uint32_t first, uint32_t count, float& leafTMax)
 				{
-					int k = 0;
-				}
+					RAYTRACER_STATS_ONLY(Statistics::GetCounters().primitiveTests += count);
+					for (uint32_t i{ first }; i < first + count; ++i)
+					{
+						float t{};
+						if (HitTest_Triangle(mesh.precomputedTriangles[i], objectRay, t) && t < tMax)
+						{
+							tMax = t;
+							triangleIndex = i;
+							didHit = true;
+						}
+					}
 
-				normals.push_back(normal);
-			}
+					leafTMax = tMax;
+					return false;
+				});
 
+			return didHit;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, float& tMax, uint32_t& triangleIndex)
+		{
+			return HitTest_TriangleMesh(mesh, mesh.inverseTransform, ray, tMax, triangleIndex);
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Matrix& inverseTransform, const Ray& ray)
+		{
+			const Ray objectRay{ inverseTransform.TransformPoint(ray.origin), inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
+
+			//Any hit will do, stop at the first one
+			bool didHit{ false };
+			mesh.bvh.Traverse(objectRay, objectRay.max, [&](uint32_t first, uint32_t count, float&)
+				{
+					for (uint32_t i{ first }; i < first + count; ++i)
+					{
+						RAYTRACER_STATS_ONLY(++Statistics::GetCounters().primitiveTests);
+						float t{};
+						if (HitTest_Triangle(mesh.precomputedTriangles[i], objectRay, t))
+						{
+							didHit = true;
+							return true;
+						}
+					}
+					return false;
+				});
+
+			return didHit;
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			return HitTest_TriangleMesh(mesh, mesh.inverseTransform, ray);
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (ignoreHitRecord)
+				return HitTest_TriangleMesh(mesh, ray);
+
+			float t{ FLT_MAX };
+			uint32_t triangleIndex{};
+			if (!HitTest_TriangleMesh(mesh, ray, t, triangleIndex))
+				return false;
+
+			hitRecord.t = t;
+			hitRecord.didHit = true;
+			hitRecord.origin = ray.origin + t * ray.direction;
+			hitRecord.normal = mesh.GetWorldNormal(triangleIndex);
+			hitRecord.materialIndex = mesh.GetMaterialIndex(triangleIndex);
 			return true;
 		}
-#pragma warning(pop)
+#pragma endregion
+	}
+
+	namespace LightUtils
+	{
+		//Direction from target to light
+		inline Vector3 GetDirectionToLight(const Light& light, const Vector3 origin)
+		{
+			
+			return light.origin - origin;
+		}
+
+		inline ColorRGB GetRadiance(const Light& light, const Vector3& target)
+		{
+			if(light.type == LightType::Directional)
+			{
+				return  light.color * light.intensity;
+			}else
+			{
+				Vector3 diff = (light.origin - target);
+				return light.color * (light.intensity/Vector3::Dot(diff,diff));
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -1,53 +1,194 @@
 //External includes
+#if __has_include("vld.h")
 #include "vld.h"
+#endif
+#ifndef RAYTRACER_HEADLESS
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
+#endif
 
 //Standard includes
+#include <chrono>
 #include <iostream>
+#include <optional>
+#include <string>
 
 //Project includes
+#include "Benchmark.h"
+#include "CommandLine.h"
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "SceneFile.h"
 
 using namespace dae;
 
+//Command line options, all optional
+struct Options
+{
+	std::string sceneName{ "W4" };
+	int width{ 640 };
+	int height{ 480 };
+	int threadCount{}; //0 = every hardware thread
+	int frameCount{ 1 }; //Headless only, the window keeps rendering until it is closed
+	std::string outputPath{ "RayTracing_Buffer.bmp" };
+	bool isProgressive{ false }; //Accumulate a jittered sample per frame (anti-aliasing), F5 toggles it in the window
+	std::optional<ProjectionType> projection{}; //Overrides the scene's camera when given, F6 cycles it in the window
+	bool isBVHBenchmarkRequested{ false }; //Run the BVH scaling benchmark instead of rendering
+#ifdef RAYTRACER_HEADLESS
+	bool isHeadless{ true };
+#else
+	bool isHeadless{ false };
+#endif
+};
+
+//Every option of the renderer, written to options while parsing
+CommandLine CreateCommandLine(Options& options)
+{
+	std::string sceneNames{};
+	for (const std::string& name : GetSceneNames())
+	{
+		sceneNames += ' ' + name;
+	}
+
+	CommandLine commandLine{ "RayTracer" };
+	commandLine.AddFlag("--headless", "render without a window and write the last frame to --output", options.isHeadless);
+	commandLine.AddFlag("--progressive", "accumulate one jittered sample per frame (anti-aliased after a few frames)", options.isProgressive);
+	commandLine.AddString("--scene", "name", "scene to render (" + sceneNames + " ) or a .scene file, default W4", options.sceneName);
+	commandLine.AddInt("--width", "pixels", "default 640", 1, options.width);
+	commandLine.AddInt("--height", "pixels", "default 480", 1, options.height);
+	commandLine.AddInt("--threads", "count", "render threads, default 0 (all hardware threads)", 0, options.threadCount);
+	commandLine.AddInt("--frames", "count", "frames to render in headless mode, default 1", 1, options.frameCount);
+	commandLine.AddString("--output", "path", "image to write (.bmp or .ppm), default RayTracing_Buffer.bmp", options.outputPath);
+	commandLine.AddValue("--projection", "type", "pinhole, orthographic or thinlens (depth of field, use with --progressive), default the scene's camera",
+		[&options](const char* pValue)
+		{
+			const std::string projection{ pValue };
+			if (projection == "pinhole")
+				options.projection = ProjectionType::Pinhole;
+			else if (projection == "orthographic")
+				options.projection = ProjectionType::Orthographic;
+			else if (projection == "thinlens")
+				options.projection = ProjectionType::ThinLens;
+			else
+				return false;
+			return true;
+		});
+	commandLine.AddFlag("--benchmark-bvh", "run the BVH scaling benchmark and exit", options.isBVHBenchmarkRequested);
+	return commandLine;
+}
+
+//Creates, initializes and builds the scene on the pool of the renderer, nullptr (after printing why) when that fails
+Scene* LoadScene(const Options& options, const Renderer* pRenderer)
+{
+	ThreadPool* pThreadPool{ pRenderer->GetThreadPool() };
+	const auto pScene = CreateScene(options.sceneName, pThreadPool);
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << options.sceneName << ", use a .scene file or one of";
+		for (const std::string& name : GetSceneNames())
+		{
+			std::cout << ' ' << name;
+		}
+		std::cout << std::endl;
+		return nullptr;
+	}
+	pScene->Initialize();
+	if (const auto pSceneFile = dynamic_cast<const Scene_File*>(pScene); pSceneFile && !pSceneFile->IsLoaded())
+	{
+		std::cout << "Could not load scene " << pSceneFile->GetError() << std::endl;
+		delete pScene;
+		return nullptr;
+	}
+
+	pScene->BuildAccelerationStructure(pThreadPool);
+	const AccelerationStructureStats& stats{ pScene->GetAccelerationStructureStats() };
+	std::cout << "Built the acceleration structure in " << stats.lastBuildMs << " ms (" << stats.nodeCount << " nodes)" << std::endl;
+
+	if (options.projection)
+		pScene->GetCamera().projection = *options.projection;
+	return pScene;
+}
+
+int RunHeadless(const Options& options)
+{
+	const auto pRenderer = new Renderer(options.width, options.height, static_cast<uint32_t>(options.threadCount));
+	const auto pScene = LoadScene(options, pRenderer);
+	if (!pScene)
+	{
+		delete pRenderer;
+		return 1;
+	}
+	if (options.isProgressive)
+		pRenderer->ToggleProgressive();
+	std::cout << "Rendering " << options.sceneName << " at " << options.width << "x" << options.height
+		<< " on " << pRenderer->GetThreadCount() << " threads" << std::endl;
+
+	//Nothing moves without input, every frame renders the same image (later frames run with the measured tile costs)
+	double totalMilliseconds{};
+	for (int frame{}; frame < options.frameCount; ++frame)
+	{
+		//Unchanged frames would only be presented, retrace them so every frame is timed (progressive frames add a sample anyway)
+		if (!pRenderer->IsProgressive())
+			pRenderer->Invalidate();
+
+		const auto start{ std::chrono::steady_clock::now() };
+		pRenderer->Render(pScene);
+		const double milliseconds{ std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() };
+		totalMilliseconds += milliseconds;
+
+		std::cout << "Frame " << frame << ": " << milliseconds << " ms" << std::endl;
+	}
+	std::cout << "Average: " << totalMilliseconds / options.frameCount << " ms/frame" << std::endl;
+	if (pRenderer->IsProgressive())
+		std::cout << "Accumulated " << pRenderer->GetSampleCount() << " samples per pixel" << std::endl;
+
+	const bool isSaved{ pRenderer->SaveBufferToImage(options.outputPath) };
+	if (isSaved)
+		std::cout << "Saved " << options.outputPath << std::endl;
+	else
+		std::cout << "Something went wrong. " << options.outputPath << " not saved!" << std::endl;
+
+	delete pScene;
+	delete pRenderer;
+	return isSaved ? 0 : 1;
+}
+
+#ifndef RAYTRACER_HEADLESS
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
-int main(int argc, char* args[])
+int RunWindowed(const Options& options)
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
-
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
-
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - **Xander Bartels**",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		width, height, 0);
+		options.width, options.height, 0);
 
 	if (!pWindow)
 		return 1;
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
-	const auto pRenderer = new Renderer(pWindow);
-
-	//const auto pScene = new Scene_W1();
-	const auto pScene = new Scene_W4();
-	pScene->Initialize();
+	const auto pRenderer = new Renderer(pWindow, static_cast<uint32_t>(options.threadCount));
+	const auto pScene = LoadScene(options, pRenderer);
+	if (!pScene)
+	{
+		delete pRenderer;
+		delete pTimer;
+		ShutDown(pWindow);
+		return 1;
+	}
+	if (options.isProgressive)
+		pRenderer->ToggleProgressive();
 
 	float dotResult{};
 	dotResult = Vector3::Dot(Vector3::UnitX, Vector3::UnitX); // 1 same direction
@@ -87,12 +228,31 @@ int main(int argc, char* args[])
 				{
 					pRenderer->CycleLightingMode();
 				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+				{
+					pRenderer->TogglePacketTracing();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+				{
+					pRenderer->ToggleProgressive();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
+				{
+					pScene->GetCamera().CycleProjection();
+				}
 				break;
 			case SDL_MOUSEBUTTONUP:
 				if (e.button.button == SDL_BUTTON_LEFT)
 				{
-					//Render a single pixel (for debugging)
-					pRenderer->Render(pScene, e.button.x, e.button.x + 1, e.button.y, e.button.y + 1);
+					//Trace a single pixel (for debugging), the frame being shown is left alone
+					HitRecord closestHit{};
+					const ColorRGB color{ pRenderer->TracePixel(pScene, e.button.x, e.button.y, closestHit) };
+					std::cout << "Pixel (" << e.button.x << ", " << e.button.y << "): ";
+					if (closestHit.didHit)
+						std::cout << "t " << closestHit.t << ", material " << closestHit.materialIndex << ", ";
+					else
+						std::cout << "no hit, ";
+					std::cout << "color " << color.r << ' ' << color.g << ' ' << color.b << std::endl;
 				}
 				break;
 			}
@@ -111,12 +271,20 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+
+			//Only scenes with moving meshes refit
+			const AccelerationStructureStats& stats{ pScene->GetAccelerationStructureStats() };
+			if (stats.refitCount > 0)
+			{
+				std::cout << "Mesh BVH: " << stats.refitCount << " refits (last " << stats.lastRefitMs << " ms), "
+					<< stats.rebuildCount << " rebuilds (last " << stats.lastRebuildMs << " ms), cost ratio " << stats.costRatio << std::endl;
+			}
 		}
 
 		//Save screenshot after full render
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
+			if (pRenderer->SaveBufferToImage(options.outputPath))
 				std::cout << "Screenshot saved!" << std::endl;
 			else
 				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
@@ -132,4 +300,34 @@ int main(int argc, char* args[])
 
 	ShutDown(pWindow);
 	return 0;
+}
+#endif
+
+int main(int argc, char* args[])
+{
+	Options options{};
+	const CommandLine commandLine{ CreateCommandLine(options) };
+	switch (commandLine.Parse(argc, args))
+	{
+	case CommandLine::ParseResult::Help:
+		return 0;
+	case CommandLine::ParseResult::Error:
+		return 1;
+	case CommandLine::ParseResult::Run:
+		break;
+	}
+
+	//Benchmarks run without a window
+	if (options.isBVHBenchmarkRequested)
+	{
+		Benchmark::RunBVHScaling();
+		return 0;
+	}
+
+	//The renderer comes first, the scene is loaded and built on its thread pool
+#ifdef RAYTRACER_HEADLESS
+	return RunHeadless(options);
+#else
+	return options.isHeadless ? RunHeadless(options) : RunWindowed(options);
+#endif
 }
\ No newline at end of file